@@ -5,6 +5,7 @@
 
 #include <DrawingLogic/CanvasWidget.h>
 #include <io/Delta_CRDT/WhiteboardSession.h>
+#include <io/Serialization/AutosaveJournal.h>
 #include <Shared/Shared.h>
 #include <UI/MainWindow.h>
 
@@ -16,6 +17,7 @@ private:
     WhiteboardSession* m_session;
     std::unique_ptr<MainWindow> m_mainWindow;
     CanvasWidget* m_canvasWidget;
+    AutosaveJournal* m_journal;
 
     QString generateClientId();
     void setupConnections();
@@ -23,8 +25,12 @@ private:
 private slots:
 
     void onLocalObjectCreated(std::shared_ptr<DrawableObject> obj);
+    void onLocalObjectsCreated(std::vector<std::shared_ptr<DrawableObject>> objs);
     void onLocalObjectModified(std::shared_ptr<DrawableObject> obj);
+    void onLocalObjectsModified(std::vector<std::shared_ptr<DrawableObject>> objs);
     void onLocalObjectDeleted(std::shared_ptr<DrawableObject> obj);
+    void onLocalObjectsDeleted(std::vector<std::shared_ptr<DrawableObject>> objs);
+    void onLocalObjectReplaced(std::shared_ptr<DrawableObject> obj, std::vector<std::shared_ptr<DrawableObject>> parts);
     void onLocalAllObjectsDeleted();
 
     void onRemoteObjectsUpdated(const QVector<DrawableObjectData>& objects);
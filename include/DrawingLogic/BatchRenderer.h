@@ -0,0 +1,60 @@
+﻿#pragma once
+
+#include <memory>
+#include <QBrush>
+#include <QLineF>
+#include <QPainter>
+#include <QPainterPath>
+#include <QRectF>
+#include <QVector>
+#include <span>
+#include <vector>
+
+class DrawableObject;
+
+// Geometry collected from every object of one style, flushed with a single
+// pen/brush change. |scale| and |clip| are the painter's, so objects can pick
+// their level of detail and skip clipped parts while filling the batch.
+struct RenderBatch {
+	qreal scale = 1.0;
+	QRectF clip;
+
+	QVector<QLineF> lines;
+	QPainterPath path;
+	QVector<QRectF> rects;
+};
+
+// Draws a z-ordered object list grouped by (color, thickness, fill). An object
+// joins the latest batch of its style as long as nothing drawn after that batch
+// overlaps it, so the result matches drawing the objects one by one.
+// Translucent objects are always drawn on their own since merging them would
+// change how overlaps blend.
+class BatchRenderer {
+public:
+	static void draw(QPainter& painter, std::span<const std::shared_ptr<DrawableObject>> objects);
+
+private:
+	struct StyleKey {
+		QRgb color = 0;
+		int thickness = 0;
+		QBrush fill;
+
+		bool operator==(const StyleKey& other) const {
+			return color == other.color && thickness == other.thickness && fill == other.fill;
+		}
+	};
+
+	struct Batch {
+		StyleKey key;
+		RenderBatch geometry;
+		QRectF bounds;
+		// Set for objects drawn on their own.
+		std::shared_ptr<DrawableObject> single;
+	};
+
+	// How many batches back an object may be hoisted; bounds the cost per object.
+	static constexpr size_t MAX_LOOKBACK = 32;
+	static constexpr size_t SCRATCH_BYTES = 16 * 1024;
+
+	static void flush(QPainter& painter, const Batch& batch);
+};
@@ -1,15 +1,36 @@
 ﻿#pragma once
 
+#include <memory_resource>
+#include <QElapsedTimer>
+#include <span>
+#include <QPixmap>
+#include <QRegion>
+#include <QTimer>
 #include <QWidget>
+#include <unordered_set>
 
 #include <DrawingLogic/DrawableObject.h>
 #include <DrawingLogic/Drawer.h>
+#include <DrawingLogic/SpatialIndex.h>
+#include <DrawingLogic/TileCache.h>
+#include <DrawingLogic/TileRasterizer.h>
+#include <DrawingLogic/ZOrderList.h>
 
 
 class CanvasWidget final : public QWidget {
 	Q_OBJECT
 
 public:
+	struct FrameStats {
+		quint64 frames = 0;
+		// Refresh intervals that passed between a frame being issued and painted.
+		quint64 dropped_frames = 0;
+		// Oldest queued input of a frame until the end of its paintEvent.
+		qint64 last_latency_us = 0;
+		qint64 max_latency_us = 0;
+		double average_latency_us = 0;
+	};
+
 	explicit CanvasWidget(QWidget* parent = nullptr, const QString& userId = QString());
 	void set_drawer(std::unique_ptr<Drawer> drawer);
 
@@ -25,8 +46,41 @@ public:
 	QString getUserId() {
 		return m_userId;
 	}
+	[[nodiscard]] const FrameStats& frame_stats() const { return m_frame_stats; }
+	// Screen pixels per world unit.
+	[[nodiscard]] qreal view_scale() const { return m_scale; }
+
+	// Schedules a repaint of just the screen area covering |world_rect|.
+	void damage_world(const QRectF& world_rect);
+	void damage_object(const std::shared_ptr<DrawableObject>& object);
+
 	void addObject(std::shared_ptr<DrawableObject> obj);
+	// Appends non-null |objects| in order with one list insert and a single
+	// tile invalidation, reported by a single objectsCreated.
+	void add_objects(const std::vector<std::shared_ptr<DrawableObject>>& objects);
 	bool remove_object(const std::shared_ptr<DrawableObject>& object);
+	// Removes all given objects with one compaction of the object list and a
+	// single objectsDeleted notification. Returns how many were removed.
+	size_t remove_objects(const std::vector<std::shared_ptr<DrawableObject>>& objects);
+	[[nodiscard]] std::vector<std::shared_ptr<DrawableObject>> objects_in(const QRectF& world_rect) const;
+
+	// Between begin and end, deletions are collected and reported as one
+	// objectsDeleted when the outermost batch ends.
+	void begin_edit_batch();
+	void end_edit_batch();
+	// Swaps |object| for |parts| at the same place in the z-order and reports
+	// it as one objectReplaced. Without parts this is a plain removal.
+	bool replace_object(const std::shared_ptr<DrawableObject>& object, const std::vector<std::shared_ptr<DrawableObject>>& parts);
+
+	// The selection is outlined on top of the scene. While it is being dragged
+	// it is lifted out of the tiles and painted with just a translation; the
+	// move reaches the objects once, on commit, as a single objectsModified.
+	void set_selection(std::vector<std::shared_ptr<DrawableObject>> objects);
+	[[nodiscard]] const std::vector<std::shared_ptr<DrawableObject>>& selection() const { return m_selection; }
+	[[nodiscard]] const QRectF& selection_bounds() const { return m_selection_bounds; }
+	void begin_selection_move();
+	void move_selection_to(QPointF offset);
+	void commit_selection_move();
 
 protected:
 	void paintEvent(QPaintEvent*) override;
@@ -37,10 +91,24 @@ protected:
 	void wheelEvent(QWheelEvent* event) override;
 
 private:
-	std::vector<std::shared_ptr<DrawableObject>> m_objects;
+	ZOrderList m_objects;
+	SpatialIndex m_index;
+	// Store slot of a committed object, found through its z in the index.
+	[[nodiscard]] std::optional<size_t> slot_of(const DrawableObject* object) const;
+	int m_edit_batch_depth = 0;
+	std::vector<std::shared_ptr<DrawableObject>> m_batched_deletes;
+
+	std::vector<std::shared_ptr<DrawableObject>> m_selection;
+	QRectF m_selection_bounds;
+	QPointF m_selection_offset;
+	std::unordered_set<const DrawableObject*> m_lifted;
+	TileCache m_tiles;
+	TileRasterizer m_rasterizer;
 	std::unique_ptr<Drawer> m_drawer;
-	int m_next_id = 0;
+	quint64 m_next_id = 0;
 	QString m_userId;
+	// Index of m_userId in the ObjectId client table.
+	quint16 m_client = 0;
 	
 	std::unordered_map<QString, std::shared_ptr<DrawableObject>> m_previews;
 	std::shared_ptr<DrawableObject> m_tool_preview;
@@ -54,16 +122,65 @@ private:
 	QPoint m_last_pan_pos;
 	bool m_panning = false;
 
+	// While panning or zooming, the last full frame is only translated and
+	// scaled; the real re-render happens once input has been idle for a while.
+	static constexpr int GESTURE_IDLE_MS = 120;
+	QPixmap m_gesture_frame;
+	QPointF m_gesture_offset;
+	qreal m_gesture_scale = 1.0;
+	QTimer m_gesture_idle;
+	// Set while grabbing that frame: previews, the lifted selection and its
+	// outline are painted live on top of it, so they are left out.
+	bool m_grabbing_scene = false;
+
+	[[nodiscard]] bool in_gesture() const { return !m_gesture_frame.isNull(); }
+	void begin_gesture();
+	void end_gesture();
+	void draw_gesture_frame(QPainter& painter);
+
+	// Input moves are queued and handed to the drawer once per frame; damage is
+	// collected and turned into at most one update() per refresh interval.
+	QTimer m_frame_timer;
+	QElapsedTimer m_clock;
+	QVector<QPointF> m_pending_moves;
+	QRegion m_pending_damage;
+	qint64 m_oldest_input_ns = -1;
+	qint64 m_frame_input_ns = -1;
+	qint64 m_last_frame_ns = -1;
+	qint64 m_frame_issued_ns = -1;
+	bool m_in_frame = false;
+	FrameStats m_frame_stats;
+	// Scratch memory for lists built while painting; released after every paint.
+	std::pmr::monotonic_buffer_resource m_frame_arena;
+
+	void schedule_repaint(const QRect& screen_rect);
+	void schedule_frame();
+	void run_frame();
+	void flush_pending_moves();
+	void record_presented_frame();
+	[[nodiscard]] qint64 frame_interval_ns() const;
+
 	void create_drawer_by_name(const QString& name);
+	void draw_tiles(QPainter& painter, const QRectF& visible, const QRectF& dirty);
+	void draw_fallback(QPainter& painter, std::span<const TileKey> missing);
+	[[nodiscard]] QRect tile_screen_rect(TileKey key) const;
+	// Objects for a tile job, without the lifted selection.
+	[[nodiscard]] std::vector<std::shared_ptr<DrawableObject>> tile_snapshot(const QRectF& world_rect) const;
+	[[nodiscard]] QRect selection_screen_rect() const;
+	void draw_lifted_selection(QPainter& painter, const QRectF& dirty);
 
 signals:
 	void objectCreated(std::shared_ptr<DrawableObject> obj);
+	void objectsCreated(std::vector<std::shared_ptr<DrawableObject>> objs);
 	void objectDeleted(std::shared_ptr<DrawableObject> obj);
+	void objectsDeleted(std::vector<std::shared_ptr<DrawableObject>> objs);
 	void objectModified(std::shared_ptr<DrawableObject> obj);
+	void objectsModified(std::vector<std::shared_ptr<DrawableObject>> objs);
+	void objectReplaced(std::shared_ptr<DrawableObject> obj, std::vector<std::shared_ptr<DrawableObject>> parts);
 	void allObjectsDeleted();
 
 public:
-	QString generate_id();
+	ObjectId generate_id();
 	void set_pen_color(const QColor& color);
 	void set_fill(QBrush b);
 	void set_pen_thickness(int value);
@@ -72,4 +189,6 @@ public:
 
 	[[nodiscard]] QPointF to_world(const QPointF& screen_pos) const;
 	[[nodiscard]] QPointF to_screen(const QPointF& world_pos) const;
+	[[nodiscard]] QRectF to_screen(const QRectF& world_rect) const;
+	[[nodiscard]] QRectF visible_world_rect() const;
 };
@@ -1,35 +1,64 @@
 ﻿#pragma once
 
+#include <algorithm>
+#include <array>
+#include <functional>
 #include <memory>
+#include <numbers>
 #include <QBrush>
 #include <QColor>
 #include <QPainter>
 #include <QPainterPath>
 #include <QPointF>
 #include <QJsonObject>
+#include <span>
 #include <utility>
 #include <vector>
 #include <QByteArray>
 
+#include <DrawingLogic/ObjectPool.h>
+#include <DrawingLogic/StrokeCodec.h>
 #include <Shared/Shared.h>
 
+struct RenderBatch;
 
 class DrawableObject {
 protected:
-    QString id;
+    ObjectId id;
     int thickness;
     QColor color;
     QBrush fill;
+    // Cached world bounds, inflated by the pen margin. Subclasses refresh it
+    // with update_bounds() whenever their geometry or thickness changes.
+    QRectF bounds;
+
+    // The default square cap reaches half the pen width along both axes, so a
+    // diagonal line end sticks out by half the width times sqrt(2).
+    [[nodiscard]] qreal pen_margin() const { return std::max(thickness * (std::numbers::sqrt2 / 2.0), 0.5); }
+    [[nodiscard]] virtual QRectF compute_bounds() const = 0;
+    void update_bounds() { bounds = compute_bounds(); }
+    // Cheap rejection for hit tests: true when |pos| cannot be within
+    // |brush_thickness| of the object.
+    [[nodiscard]] bool outside_bounds(const QPointF pos, const int brush_thickness) const {
+        return !bounds.adjusted(-brush_thickness, -brush_thickness, brush_thickness, brush_thickness).contains(pos);
+    }
+    // Same test for the whole segment [from, to].
+    [[nodiscard]] bool outside_bounds(const QPointF from, const QPointF to, const int brush_thickness) const {
+        const QRectF area = bounds.adjusted(-brush_thickness, -brush_thickness, brush_thickness, brush_thickness);
+        return std::max(from.x(), to.x()) < area.left() || std::min(from.x(), to.x()) > area.right()
+            || std::max(from.y(), to.y()) < area.top() || std::min(from.y(), to.y()) > area.bottom();
+    }
 
 public:
-    explicit DrawableObject(const QString id_, const int thickness_ = 3, QColor color_ = Qt::black, const QBrush& fill_ = Qt::NoBrush)
+    explicit DrawableObject(const ObjectId id_, const int thickness_ = 3, QColor color_ = Qt::black, const QBrush& fill_ = Qt::NoBrush)
         : id(id_), thickness(thickness_), color(std::move(color_)), fill(fill_) {}
 
     virtual ~DrawableObject() = default;
 
-    [[nodiscard]] QString get_id() const { return id; }
+    [[nodiscard]] ObjectId get_id() const { return id; }
+    [[nodiscard]] virtual ObjType get_type() const = 0;
     [[nodiscard]] int get_thickness() const { return thickness; }
-    void set_thickness(const int t) { thickness = t; }
+    void set_thickness(const int t) { thickness = t; update_bounds(); }
 
     [[nodiscard]] QColor get_color() const { return color; }
     void set_color(const QColor& c) { color = c; }
@@ -42,12 +71,31 @@ public:
     [[nodiscard]] virtual std::shared_ptr<DrawableObject> clone() const = 0;
     [[nodiscard]] virtual QPointF get_end() const = 0;
 	[[nodiscard]] virtual bool contains_point(QPointF pos, int thickness) const = 0;
+    // Whether a brush of radius |thickness| dragged from |from| to |to| touches
+    // the object. The default only samples the two ends.
+    [[nodiscard]] virtual bool intersects_segment(QPointF from, QPointF to, int thickness) const;
+    // Cuts away what that brush covers. Returns false when it misses; otherwise
+    // |parts| receives the surviving pieces, named by |make_id|. Objects that
+    // cannot be split are erased whole.
+    virtual bool erase_along(QPointF from, QPointF to, int thickness, const std::function<ObjectId()>& make_id,
+        std::vector<std::shared_ptr<DrawableObject>>& parts) const;
+    // World-space bounds including half the pen width.
+    [[nodiscard]] const QRectF& bounding_rect() const { return bounds; }
+
+    // Objects that can be merged into a BatchRenderer batch of their style;
+    // everything else is drawn on its own through draw().
+    [[nodiscard]] virtual bool batchable() const { return false; }
+    virtual void add_to_batch(RenderBatch&) const {}
 
     virtual QJsonObject toJson() const;
-    static std::shared_ptr<DrawableObject> fromJson(const QString id, const ObjType type, const QJsonObject& json);
+    static std::shared_ptr<DrawableObject> fromJson(const ObjectId id, const ObjType type, const QJsonObject& json);
+
+    // Layout revision of toBin() records. Revision 1 stored stroke points as
+    // raw QPointF; revision 2 stores them packed.
+    static constexpr qint32 BIN_VERSION = 2;
 
     virtual QByteArray toBin() const = 0;
-    static std::shared_ptr<DrawableObject> fromBin(QDataStream& stream, ObjType type);
+    static std::shared_ptr<DrawableObject> fromBin(QDataStream& stream, ObjType type, qint32 version = BIN_VERSION);
 
     virtual DrawableObjectData toDrawableObjectData() const;
     static std::shared_ptr<DrawableObject> fromDrawableObjectData(const DrawableObjectData& data);
@@ -58,19 +106,28 @@ class DrawableLine : public DrawableObject {
     QPointF start, end;
 
 public:
-    DrawableLine(QString id_, QPointF s, QPointF e, int thickness_ = 3, QColor color_ = Qt::black)
-        : DrawableObject(id_, thickness_, std::move(color_)), start(s), end(e) {}
+    DrawableLine(ObjectId id_, QPointF s, QPointF e, int thickness_ = 3, QColor color_ = Qt::black)
+        : DrawableObject(id_, thickness_, std::move(color_)), start(s), end(e) { update_bounds(); }
 
+    [[nodiscard]] ObjType get_type() const override { return ObjType::Line; }
     [[nodiscard]] QPointF get_start() const { return start; }
     [[nodiscard]] QPointF get_end() const override { return end; }
+    // For previews only; committed objects are never mutated.
+    void set_end(const QPointF e) { end = e; update_bounds(); }
 
     void draw(QPainter& painter) const override;
     void move_by(QPointF delta) override;
     [[nodiscard]] std::shared_ptr<DrawableObject> clone() const override;
 	[[nodiscard]] bool contains_point(QPointF pos, int thickness) const override;
+    [[nodiscard]] bool intersects_segment(QPointF from, QPointF to, int thickness) const override;
+    bool erase_along(QPointF from, QPointF to, int thickness, const std::function<ObjectId()>& make_id,
+        std::vector<std::shared_ptr<DrawableObject>>& parts) const override;
+    [[nodiscard]] QRectF compute_bounds() const override;
+    [[nodiscard]] bool batchable() const override { return true; }
+    void add_to_batch(RenderBatch& batch) const override;
 
     QJsonObject toJson() const override;
-    static std::shared_ptr<DrawableObject> fromJson(const QString id, const QJsonObject& json);
+    static std::shared_ptr<DrawableObject> fromJson(const ObjectId id, const QJsonObject& json);
 
     QByteArray toBin() const ;
     static std::shared_ptr<DrawableObject> fromBin(QDataStream& stream);
@@ -80,47 +137,107 @@ public:
 };
 
 class DrawableBrokenLine : public DrawableObject {
+    // The full-resolution path is split into runs of CHUNK_POINTS points so a
+    // clipped paint (a tile, a damaged strip) only strokes the runs it touches,
+    // and a growing stroke only ever extends its last run.
+    struct PathChunk {
+        QPainterPath path;
+        QRectF bounds;
+        // Where the chunk's first sample starts in |packed|.
+        stroke_codec::Cursor start;
+    };
+
+    // A finished stroke keeps its samples only in |packed| (see stroke_codec)
+    // and decodes them on demand; |points| holds them while the stroke grows.
     QVector<QPointF> points;
-    QPainterPath path;
+    QByteArray packed;
+    qsizetype point_count = 0;
+    QPointF last_point;
+    QVector<PathChunk> chunks;
+    QRectF points_bounds;
+    // Douglas-Peucker simplifications of the stroke, finest first, used when a
+    // screen pixel covers more than the level's tolerance.
+    QVector<QPainterPath> lod_paths;
+    QVector<qreal> lod_tolerances;
 
 public:
-    DrawableBrokenLine(QString id_, const QVector<QPointF>& points_, int thickness_ = 3, QColor color_ = Qt::black);
+    // Packs the points on the coarsest grid that holds them exactly, or as
+    // raw doubles when none does.
+    DrawableBrokenLine(ObjectId id_, const QVector<QPointF>& points_, int thickness_ = 3, QColor color_ = Qt::black);
+    // Takes samples already packed by stroke_codec::encode.
+    DrawableBrokenLine(ObjectId id_, QByteArray packed_, int thickness_ = 3, QColor color_ = Qt::black);
+
+    [[nodiscard]] ObjType get_type() const override { return ObjType::BrokenLine; }
+
+    [[nodiscard]] QPointF get_end() const override;
+    // World-space points, decoded when the stroke is packed.
+    [[nodiscard]] QVector<QPointF> get_points() const;
+    [[nodiscard]] qsizetype size() const { return point_count; }
 
-    [[nodiscard]] QPointF get_end() const override { return points.back(); }
+    // Grows the stroke in place; only the last chunk of the path is touched.
+    // Returns the world rect covered by the new segment.
+    QRectF append_point(QPointF point);
 
     void draw(QPainter& painter) const override;
     void move_by(QPointF delta) override;
     [[nodiscard]] std::shared_ptr<DrawableObject> clone() const override;
 	[[nodiscard]] bool contains_point(QPointF pos, int thickness) const override;
+    [[nodiscard]] bool intersects_segment(QPointF from, QPointF to, int thickness) const override;
+    bool erase_along(QPointF from, QPointF to, int thickness, const std::function<ObjectId()>& make_id,
+        std::vector<std::shared_ptr<DrawableObject>>& parts) const override;
+    [[nodiscard]] QRectF compute_bounds() const override;
+    [[nodiscard]] bool batchable() const override { return true; }
+    void add_to_batch(RenderBatch& batch) const override;
 
     QJsonObject toJson() const override;
-    static std::shared_ptr<DrawableObject> fromJson(const QString id, const QJsonObject& json);
+    static std::shared_ptr<DrawableObject> fromJson(const ObjectId id, const QJsonObject& json);
 
     QByteArray toBin() const override;
-    static std::shared_ptr<DrawableObject> fromBin(QDataStream& stream);
+    static std::shared_ptr<DrawableObject> fromBin(QDataStream& stream, qint32 version = BIN_VERSION);
 
     DrawableObjectData toDrawableObjectData() const override;
     static std::shared_ptr<DrawableObject> fromDrawableObjectData(const DrawableObjectData& data);
 private:
+    static constexpr qsizetype CHUNK_POINTS = 256;
+    static constexpr qsizetype LOD_MIN_POINTS = 32;
+    static constexpr qreal LOD_SCREEN_TOLERANCE = 0.5;
+
+    // World-space samples in packed form, as stored in files and deltas.
+    [[nodiscard]] QByteArray packed_points() const;
+    // Samples of chunk |k|: a view of |points| while the stroke grows, else
+    // just that chunk decoded into |buffer|.
+    [[nodiscard]] std::span<const QPointF> chunk_points(qsizetype k, std::array<QPointF, CHUNK_POINTS>& buffer) const;
+    void index_chunks();
     void rebuild_path();
+    void extend_path(qsizetype index);
+    void rebuild_lod();
+    // Coarsest simplified path fine enough for |scale|, or nullptr for full resolution.
+    [[nodiscard]] const QPainterPath* lod_for_scale(qreal scale) const;
 };
 
 class DrawableRectangle : public DrawableObject {
     QPointF start, end;
 
 public:
-    DrawableRectangle(QString id_, QPointF s, QPointF e, int thickness_ = 3, QColor color_ = Qt::black, const QBrush& fill_ = Qt::NoBrush)
-        : DrawableObject(id_, thickness_, std::move(color_), fill_), start(s), end(e) {}
+    DrawableRectangle(ObjectId id_, QPointF s, QPointF e, int thickness_ = 3, QColor color_ = Qt::black, const QBrush& fill_ = Qt::NoBrush)
+        : DrawableObject(id_, thickness_, std::move(color_), fill_), start(s), end(e) { update_bounds(); }
 
+    [[nodiscard]] ObjType get_type() const override { return ObjType::Rectangle; }
     [[nodiscard]] QPointF get_end() const override { return end; }
+    // For previews only; committed objects are never mutated.
+    void set_end(const QPointF e) { end = e; update_bounds(); }
 
     void draw(QPainter& painter) const override;
     void move_by(QPointF delta) override;
     [[nodiscard]] std::shared_ptr<DrawableObject> clone() const override;
 	[[nodiscard]] bool contains_point(QPointF pos, int thickness) const override;
+    [[nodiscard]] bool intersects_segment(QPointF from, QPointF to, int thickness) const override;
+    [[nodiscard]] QRectF compute_bounds() const override;
+    [[nodiscard]] bool batchable() const override { return true; }
+    void add_to_batch(RenderBatch& batch) const override;
 
     QJsonObject toJson() const override;
-    static std::shared_ptr<DrawableObject> fromJson(const QString id, const QJsonObject& json);
+    static std::shared_ptr<DrawableObject> fromJson(const ObjectId id, const QJsonObject& json);
 
     QByteArray toBin() const override;
     static std::shared_ptr<DrawableObject> fromBin(QDataStream& stream);
@@ -145,8 +262,10 @@ class DrawableAssistCircle : public DrawableObject {
     }
 
 public:
-	DrawableAssistCircle(QString id_, QPointF center_, int thickness_, QColor color_ = Qt::black)
-		: DrawableObject(id_, thickness_, std::move(color_)), center(center_) {}
+	DrawableAssistCircle(ObjectId id_, QPointF center_, int thickness_, QColor color_ = Qt::black)
+		: DrawableObject(id_, thickness_, std::move(color_)), center(center_) { update_bounds(); }
+
+	[[nodiscard]] ObjType get_type() const override { return ObjType::AssistCircle; }
 
 	void draw(QPainter& painter) const override {
 		QPen pen(color, 1);
@@ -155,10 +274,13 @@ public:
 		painter.drawEllipse(center, thickness, thickness);
 	}
 
-	void move_by(QPointF delta) override { center += delta; }
+	void move_by(QPointF delta) override {
+		center += delta;
+		bounds.translate(delta);
+	}
 
 	[[nodiscard]] std::shared_ptr<DrawableObject> clone() const override {
-		return std::make_shared<DrawableAssistCircle>(id, center, thickness, color);
+		return make_drawable<DrawableAssistCircle>(id, center, thickness, color);
 	}
 
 	[[nodiscard]] bool contains_point(const QPointF pos, const int brush_thickness) const override {
@@ -167,8 +289,14 @@ public:
 
 	[[nodiscard]] QPointF get_end() const override { return center; }
 
+	[[nodiscard]] QRectF compute_bounds() const override {
+		const qreal r = thickness + 1.0;
+		return QRectF(center.x() - r, center.y() - r, 2 * r, 2 * r);
+	}
+
 	[[nodiscard]] double get_radius() const { return thickness; }
 	[[nodiscard]] QPointF get_center() const { return center; }
+	void set_center(const QPointF c) { center = c; update_bounds(); }
     
 };
 
@@ -6,6 +6,7 @@
 #include <vector>
 
 #include <DrawingLogic/DrawableObject.h>
+#include <DrawingLogic/Geometry.h>
 
 class CanvasWidget;
 class DrawableObject;
@@ -30,6 +31,13 @@ public:
 	virtual void on_mouse_press(CanvasWidget* canvas, QPointF pos) = 0;
 	virtual void on_mouse_move(CanvasWidget* canvas, QPointF pos) = 0;
 	virtual void on_mouse_release(CanvasWidget* canvas, QPointF pos) = 0;
+
+	// All moves queued since the last frame, oldest first.
+	virtual void on_mouse_move_batch(CanvasWidget* canvas, const QVector<QPointF>& positions) {
+		for (const QPointF& pos : positions) {
+			on_mouse_move(canvas, pos);
+		}
+	}
 };
 
 
@@ -40,9 +48,17 @@ public:
     void on_mouse_release(CanvasWidget* canvas, QPointF pos) override;
 
 private:
-    QVector<QPointF> m_points;
+    // Largest deviation of the committed stroke from the raw samples, in
+    // screen pixels at the zoom the stroke was drawn at.
+    static constexpr qreal FIT_SCREEN_TOLERANCE = 0.5;
+    // Grid the committed samples are packed on, in screen pixels at that zoom;
+    // well below what antialiasing can show.
+    static constexpr qreal PACK_SCREEN_STEP = 1.0 / 16;
+
     bool m_drawing = false;
 	std::shared_ptr<DrawableBrokenLine> preview_path;
+	// Fed every sample; only its output is committed.
+	geometry::PolylineFitter fitter{ FIT_SCREEN_TOLERANCE };
 
 };
 
@@ -51,6 +67,9 @@ public:
     void on_mouse_press(CanvasWidget* canvas, QPointF pos) override;
     void on_mouse_move(CanvasWidget* canvas, QPointF pos) override;
     void on_mouse_release(CanvasWidget* canvas, QPointF pos) override;
+    void on_mouse_move_batch(CanvasWidget* canvas, const QVector<QPointF>& positions) override {
+        if (!positions.isEmpty()) on_mouse_move(canvas, positions.back());
+    }
 
 private:
     bool m_drawing = false;
@@ -65,6 +84,9 @@ public:
     void on_mouse_press(CanvasWidget* canvas, QPointF pos) override;
     void on_mouse_move(CanvasWidget* canvas, QPointF pos) override;
     void on_mouse_release(CanvasWidget* canvas, QPointF pos) override;
+    void on_mouse_move_batch(CanvasWidget* canvas, const QVector<QPointF>& positions) override {
+        if (!positions.isEmpty()) on_mouse_move(canvas, positions.back());
+    }
 
 private:
     bool m_drawing = false;
@@ -76,12 +98,26 @@ private:
 
 class EraserTool final : public Drawer {
 public:
+    // Whole removes every object the brush touches; Partial cuts strokes and
+    // lines at the brush and keeps what lies outside it.
+    enum class Mode { Whole, Partial };
+
+    explicit EraserTool(Mode mode_ = Mode::Whole) : mode(mode_) {}
+
     void on_mouse_press(CanvasWidget* canvas, QPointF pos) override;
     void on_mouse_move(CanvasWidget* canvas, QPointF pos) override;
     void on_mouse_release(CanvasWidget* canvas, QPointF pos) override;
+    void on_mouse_move_batch(CanvasWidget* canvas, const QVector<QPointF>& positions) override;
 
 private:
-    static void erase_at(CanvasWidget* canvas, QPointF pos, int brush_thickness) ;
+    // Erases everything touched by the brush swept along |path|: one index
+    // query for the whole path, then one capsule test per segment.
+    void erase_along(CanvasWidget* canvas, const QVector<QPointF>& path, int brush_thickness) const;
+    // Splits |object| along |path|. Returns false when the brush missed it.
+    static bool cut(CanvasWidget* canvas, const std::shared_ptr<DrawableObject>& object,
+        const QVector<QPointF>& path, int brush_thickness, std::vector<std::shared_ptr<DrawableObject>>& parts);
+
+    Mode mode;
 	bool is_erasing = false;
 
 	QPointF center;
@@ -90,10 +126,23 @@ private:
 
 class MoveTool final : public Drawer {
 	public:
+    // How a drag on empty canvas selects: by rubber band or by a free-hand lasso.
+    enum class Mode { Rectangle, Lasso };
+
+    explicit MoveTool(Mode mode_ = Mode::Rectangle) : mode(mode_) {}
+
     void on_mouse_press(CanvasWidget* canvas, QPointF pos) override;
 	void on_mouse_move(CanvasWidget* canvas, QPointF pos) override;
 	void on_mouse_release(CanvasWidget* canvas, QPointF pos) override;
+    void on_mouse_move_batch(CanvasWidget* canvas, const QVector<QPointF>& positions) override;
 private:
-	std::shared_ptr<DrawableObject> selected;
-	QPointF last_pos;
+	[[nodiscard]] std::shared_ptr<DrawableObject> object_at(CanvasWidget* canvas, QPointF pos) const;
+	void select_area(CanvasWidget* canvas, QPointF pos) const;
+
+	Mode mode;
+	bool dragging = false;
+	bool selecting = false;
+	QPointF press_pos;
+	std::shared_ptr<DrawableBrokenLine> lasso;
+	std::shared_ptr<DrawableRectangle> band;
 };
\ No newline at end of file
@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
+
+namespace geometry {
+
+// Douglas–Peucker simplification; keeps the first and last point and drops
+// every point closer than |tolerance| to the simplified polyline. Long inputs
+// are split into fixed spans, which bounds the worst case to linear time.
+[[nodiscard]] QVector<QPointF> simplify(const QVector<QPointF>& points, qreal tolerance);
+
+[[nodiscard]] qreal distance_to_segment_squared(QPointF p, QPointF a, QPointF b);
+// Squared distance between segments [a0, a1] and [b0, b1]; zero when they cross.
+[[nodiscard]] qreal segment_distance_squared(QPointF a0, QPointF a1, QPointF b0, QPointF b1);
+// True when any part of segment [a, b] lies inside |rect| (edges included).
+[[nodiscard]] bool segment_intersects_rect(QPointF a, QPointF b, const QRectF& rect);
+
+// True when |p| lies within |distance| of the polyline through points[0..count).
+// Vectorized over segments (SSE2, or AVX2 when the CPU has it) and returns on
+// the first block containing a hit.
+[[nodiscard]] bool polyline_within(const QPointF* points, qsizetype count, QPointF p, qreal distance);
+
+// Cuts out of the polyline everything within |radius| of segment [from, to].
+// Returns false when nothing is cut; otherwise |pieces| receives the
+// surviving runs (empty when the whole polyline is covered).
+bool erase_from_polyline(const QVector<QPointF>& points, QPointF from, QPointF to, qreal radius,
+	QVector<QVector<QPointF>>& pieces);
+
+// Streaming simplification of a stroke as it is drawn. A sample only becomes a
+// vertex once the run of samples after the previous vertex can no longer be
+// covered by one segment within |tolerance|, so jitter and collinear runs
+// collapse while the pointer moves. Each sample costs at most MAX_RUN checks.
+class PolylineFitter {
+public:
+	explicit PolylineFitter(qreal tolerance);
+
+	void add(QPointF point);
+	// The fitted polyline, ending at the latest sample.
+	[[nodiscard]] QVector<QPointF> points() const;
+
+private:
+	static constexpr qsizetype MAX_RUN = 64;
+
+	qreal m_tolerance_squared;
+	QVector<QPointF> m_vertices;
+	// Samples after the last vertex, all within tolerance of the segment from
+	// that vertex to the newest one.
+	QVector<QPointF> m_run;
+};
+
+}
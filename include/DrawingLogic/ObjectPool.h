@@ -0,0 +1,17 @@
+﻿#pragma once
+
+#include <memory>
+#include <memory_resource>
+#include <utility>
+
+// Scene objects are carved out of one pooled resource instead of a separate
+// malloc each: the pool serves same-sized blocks from large chunks, so loads,
+// clones and erase splits allocate in bulk and a board's objects stay close in
+// memory. It is synchronized since tile and save jobs may drop the last
+// reference to an object on a worker thread.
+[[nodiscard]] std::pmr::memory_resource* scene_memory();
+
+template <typename T, typename... Args>
+[[nodiscard]] std::shared_ptr<T> make_drawable(Args&&... args) {
+	return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>(scene_memory()), std::forward<Args>(args)...);
+}
@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include <memory>
+#include <optional>
+#include <QRectF>
+#include <unordered_map>
+#include <vector>
+
+class DrawableObject;
+
+// Uniform grid over world coordinates. Every object is registered in each cell
+// its bounds touch; objects spanning too many cells are kept in a separate list
+// that every query visits. Query results come back in z-order (the order the
+// objects were committed to the canvas).
+class SpatialIndex {
+public:
+	explicit SpatialIndex(qreal cell_size = 256.0);
+
+	void insert(const std::shared_ptr<DrawableObject>& object, const QRectF& bounds, quint64 z);
+	bool remove(const DrawableObject* object);
+	// Swaps |old_object| for |object| at the same z-order.
+	bool replace(const DrawableObject* old_object, const std::shared_ptr<DrawableObject>& object, const QRectF& bounds);
+	void update(const DrawableObject* object, const QRectF& bounds);
+	void set_z(const DrawableObject* object, quint64 z);
+	void clear();
+
+	[[nodiscard]] std::vector<std::shared_ptr<DrawableObject>> query(const QRectF& rect) const;
+	[[nodiscard]] bool contains(const DrawableObject* object) const;
+	[[nodiscard]] std::optional<quint64> z_of(const DrawableObject* object) const;
+	[[nodiscard]] size_t size() const { return m_entries.size(); }
+
+private:
+	struct Entry {
+		std::shared_ptr<DrawableObject> object;
+		QRectF bounds;
+		quint64 z = 0;
+		bool oversized = false;
+	};
+
+	struct CellRange {
+		qint32 left, top, right, bottom;
+		[[nodiscard]] qint64 count() const {
+			return (static_cast<qint64>(right) - left + 1) * (static_cast<qint64>(bottom) - top + 1);
+		}
+	};
+
+	static constexpr qint64 MAX_CELLS_PER_OBJECT = 64;
+
+	qreal m_cell_size;
+	std::unordered_map<quint64, std::vector<const DrawableObject*>> m_cells;
+	std::unordered_map<const DrawableObject*, Entry> m_entries;
+	std::vector<const DrawableObject*> m_oversized;
+
+	[[nodiscard]] CellRange cells_for(const QRectF& rect) const;
+	[[nodiscard]] static quint64 cell_key(qint32 x, qint32 y);
+	void link(const DrawableObject* object, Entry& entry);
+	void unlink(const DrawableObject* object, const Entry& entry);
+};
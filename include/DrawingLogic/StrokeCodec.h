@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include <QByteArray>
+#include <QPointF>
+#include <QVector>
+
+// Compact form of a freehand stroke: coordinates are rounded to fixed point
+// with |fraction_bits| binary digits below the pixel, then stored as the
+// first point followed by zig-zag varint deltas. Typical samples are a few
+// pixels apart and take two or three bytes instead of sixteen.
+//
+// Layout: u8 fraction_bits, varint count, then count (x, y) varint pairs.
+// With EXACT_BITS the pairs are little-endian doubles instead, for points no
+// grid up to MAX_FRACTION_BITS can hold without loss.
+namespace stroke_codec {
+
+constexpr int MAX_FRACTION_BITS = 16;
+constexpr int EXACT_BITS = 0xff;
+
+[[nodiscard]] QByteArray encode(const QVector<QPointF>& points, int fraction_bits);
+// Returns false, leaving |points| empty, when |data| is truncated or malformed.
+bool decode(const QByteArray& data, QVector<QPointF>& points);
+
+// Fewest fraction bits whose grid step is at most |step|, or EXACT_BITS when
+// that takes more than MAX_FRACTION_BITS.
+[[nodiscard]] int fraction_bits_for(qreal step);
+// Fewest fraction bits that hold every point of |points| exactly, or EXACT_BITS.
+[[nodiscard]] int lossless_fraction_bits(const QVector<QPointF>& points);
+
+[[nodiscard]] int fraction_bits(const QByteArray& data);
+// |point| rounded to the fixed-point grid of |fraction_bits|.
+[[nodiscard]] QPointF snap(QPointF point, int fraction_bits);
+// Moves every point of |data| by |delta| rounded to its grid (see snap()).
+// Only the first point is stored absolute, so nothing else is rewritten and
+// the decoded points move by exactly that amount. EXACT_BITS data is
+// rewritten point by point.
+[[nodiscard]] QByteArray translate(const QByteArray& data, QPointF delta);
+
+// Where decoding can resume: the byte offset of a point's deltas and the
+// fixed-point position they are relative to.
+struct Cursor {
+	qsizetype offset = 0;
+	qint64 x = 0;
+	qint64 y = 0;
+};
+
+// Point-by-point decoder that can be saved and resumed anywhere, so a range
+// of points is read without decoding what comes before it. Reads |data| in
+// place; it must outlive the reader.
+class Reader {
+public:
+	explicit Reader(const QByteArray& data);
+
+	// False when the header is malformed; next() then never yields a point.
+	[[nodiscard]] bool valid() const { return m_valid; }
+	[[nodiscard]] qsizetype count() const { return m_count; }
+
+	[[nodiscard]] Cursor cursor() const;
+	void seek(const Cursor& cursor);
+	// False at the end of the data or at a truncated delta.
+	bool next(QPointF& point);
+
+private:
+	const uchar* m_begin = nullptr;
+	const uchar* m_it = nullptr;
+	const uchar* m_end = nullptr;
+	qreal m_step = 1;
+	bool m_exact = false;
+	// Accumulated unsigned so a corrupt delta wraps instead of overflowing.
+	quint64 m_x = 0;
+	quint64 m_y = 0;
+	qsizetype m_count = 0;
+	bool m_valid = false;
+};
+
+}
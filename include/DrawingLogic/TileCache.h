@@ -0,0 +1,95 @@
+﻿#pragma once
+
+#include <memory>
+#include <QImage>
+#include <QRectF>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class DrawableObject;
+
+struct TileKey {
+	qint32 x = 0;
+	qint32 y = 0;
+
+	[[nodiscard]] quint64 pack() const {
+		return (static_cast<quint64>(static_cast<quint32>(x)) << 32) | static_cast<quint32>(y);
+	}
+	[[nodiscard]] static TileKey unpack(const quint64 packed) {
+		return { static_cast<qint32>(packed >> 32), static_cast<qint32>(packed & 0xffffffffu) };
+	}
+};
+
+// Raster cache of committed objects. Tiles are TILE_SIZE logical pixels wide and
+// anchored in world space at the current scale, so panning reuses every tile
+// and only a scale (or device pixel ratio) change drops the whole cache. The
+// tiles of the previous scale are kept as a stretched fallback until the new
+// ones have been rendered.
+class TileCache {
+public:
+	static constexpr int TILE_SIZE = 256;
+	static constexpr size_t MAX_TILES = 256;
+
+	// Returns true when the cached tiles were dropped because the scale changed.
+	bool set_scale(qreal scale, qreal device_pixel_ratio);
+	[[nodiscard]] qreal scale() const { return m_scale; }
+	[[nodiscard]] qreal device_pixel_ratio() const { return m_dpr; }
+
+	void invalidate(const QRectF& world_rect);
+	void clear();
+	// Drops tiles outside |keep| once the cache is over budget.
+	void trim(const QRectF& keep);
+
+	[[nodiscard]] std::vector<TileKey> tiles_for(const QRectF& world_rect) const;
+	[[nodiscard]] QRectF world_rect(TileKey key) const;
+	// Top-left corner of the tile relative to the view offset, in logical pixels.
+	[[nodiscard]] static QPointF origin(TileKey key);
+
+	[[nodiscard]] const QImage* find(TileKey key) const;
+	// Whether every tile covering |world_rect| is cached at the current scale.
+	[[nodiscard]] bool has_all(const QRectF& world_rect) const;
+
+	void mark_pending(TileKey key);
+	[[nodiscard]] bool is_pending(TileKey key) const;
+	// Stores a finished tile unless it was rendered for another scale or got
+	// invalidated while in flight. Returns whether the tile was kept.
+	bool accept(TileKey key, qreal scale, QImage image);
+
+	// Previous-scale tiles overlapping |world_rect|, with their world rects.
+	[[nodiscard]] std::vector<std::pair<QRectF, const QImage*>> fallback_for(const QRectF& world_rect) const;
+	[[nodiscard]] bool has_fallback() const { return !m_previous.empty(); }
+	void drop_fallback();
+
+	[[nodiscard]] static QImage rasterize(TileKey key, qreal scale, qreal device_pixel_ratio,
+		const std::vector<std::shared_ptr<DrawableObject>>& objects);
+
+private:
+	// Inclusive tile bounds; empty when right < left.
+	struct TileRange {
+		qint32 left = 0;
+		qint32 top = 0;
+		qint32 right = -1;
+		qint32 bottom = -1;
+
+		// to_tile() keeps each side within 2^31 tiles, so this cannot overflow.
+		[[nodiscard]] quint64 count() const {
+			if (right < left || bottom < top) return 0;
+			return static_cast<quint64>(static_cast<qint64>(right) - left + 1)
+				* static_cast<quint64>(static_cast<qint64>(bottom) - top + 1);
+		}
+	};
+
+	qreal m_scale = 0;
+	qreal m_dpr = 0;
+	std::unordered_map<quint64, QImage> m_tiles;
+	// Value is true when the tile was invalidated after its job was queued.
+	std::unordered_map<quint64, bool> m_pending;
+
+	qreal m_previous_scale = 0;
+	std::unordered_map<quint64, QImage> m_previous;
+
+	[[nodiscard]] TileRange tile_range(const QRectF& world_rect) const;
+	[[nodiscard]] static QRectF world_rect(TileKey key, qreal scale);
+	static void erase_intersecting(std::unordered_map<quint64, QImage>& tiles, qreal scale, const QRectF& world_rect);
+};
@@ -0,0 +1,36 @@
+﻿#pragma once
+
+#include <atomic>
+#include <memory>
+#include <QImage>
+#include <QObject>
+#include <QThreadPool>
+#include <vector>
+
+#include <DrawingLogic/TileCache.h>
+
+class DrawableObject;
+
+// Renders tiles on a private worker pool. Each job owns a snapshot of the
+// objects touching its tile; committed objects are never mutated in place
+// (CanvasWidget replaces them on move), so the snapshot stays valid while the
+// scene keeps changing. Finished tiles are delivered on the owner's thread.
+class TileRasterizer final : public QObject {
+	Q_OBJECT
+
+public:
+	explicit TileRasterizer(QObject* parent = nullptr);
+	~TileRasterizer() override;
+
+	void request(TileKey key, qreal scale, qreal device_pixel_ratio,
+		std::vector<std::shared_ptr<DrawableObject>> snapshot);
+	// Drops queued jobs; results of jobs already running are discarded.
+	void cancel_all();
+
+signals:
+	void tileReady(quint64 key, qreal scale, const QImage& image);
+
+private:
+	QThreadPool m_pool;
+	std::shared_ptr<std::atomic<quint64>> m_generation;
+};
@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include <memory>
+#include <optional>
+#include <QtGlobal>
+#include <vector>
+
+class DrawableObject;
+
+// Committed object handles in z-order, each with a z key. The keys strictly
+// increase along the list and are spaced Z_STEP apart, so the parts of a
+// split object fit between it and its successor, and an object's slot is
+// found by binary search on its key.
+class ZOrderList {
+public:
+	static constexpr quint64 Z_STEP = quint64(1) << 16;
+
+	[[nodiscard]] size_t size() const { return m_objects.size(); }
+	[[nodiscard]] bool empty() const { return m_objects.empty(); }
+
+	[[nodiscard]] const std::vector<std::shared_ptr<DrawableObject>>& objects() const { return m_objects; }
+	[[nodiscard]] const std::shared_ptr<DrawableObject>& object(const size_t i) const { return m_objects[i]; }
+	[[nodiscard]] quint64 z(const size_t i) const { return m_z[i]; }
+
+	// Adds |object| on top and returns its z.
+	quint64 append(std::shared_ptr<DrawableObject> object);
+	// Puts non-empty |parts| in place of the object at |pos|, each with its own
+	// z inside the gap up to the next object. Returns false when the gap was
+	// too small and every z in the list was renumbered instead.
+	bool split(size_t pos, const std::vector<std::shared_ptr<DrawableObject>>& parts);
+	// Swaps the object at |pos|, keeping its z.
+	void replace(size_t pos, std::shared_ptr<DrawableObject> object);
+	void erase(size_t pos);
+	// Drops every object the predicate matches in one compaction.
+	template <typename Pred>
+	size_t erase_if(Pred&& pred);
+	void clear();
+
+	// Slot of |object|, given the z it was stored with.
+	[[nodiscard]] std::optional<size_t> index_of(const DrawableObject* object, quint64 z) const;
+
+private:
+	std::vector<std::shared_ptr<DrawableObject>> m_objects;
+	std::vector<quint64> m_z;
+	quint64 m_next_z = 0;
+
+	void renumber();
+};
+
+template <typename Pred>
+size_t ZOrderList::erase_if(Pred&& pred) {
+	size_t kept = 0;
+	for (size_t i = 0; i < m_objects.size(); ++i) {
+		if (pred(m_objects[i].get())) continue;
+		if (kept != i) {
+			m_objects[kept] = std::move(m_objects[i]);
+			m_z[kept] = m_z[i];
+		}
+		++kept;
+	}
+
+	const size_t removed = m_objects.size() - kept;
+	m_objects.resize(kept);
+	m_z.resize(kept);
+	return removed;
+}
@@ -0,0 +1,55 @@
+﻿#pragma once
+
+#include <QHash>
+#include <QString>
+#include <functional>
+
+// Object identifier packed into 64 bits: the top 16 bits hold the creating
+// client, interned per process from its UUID, and the low 48 bits its counter.
+// The "<client uuid>-<counter>" text form is only built for deltas, files and
+// display, so lookups and comparisons never touch strings. Ids in any other
+// form are opaque: they live in a separate string table under OPAQUE_CLIENT.
+class ObjectId {
+public:
+    constexpr ObjectId() = default;
+    ObjectId(quint16 client, quint64 counter);
+
+    // Accepts the "<client>-<counter>" form with a canonical decimal counter;
+    // any other string is kept whole as an opaque id so foreign ids round-trip.
+    [[nodiscard]] static ObjectId fromString(const QString& text);
+    [[nodiscard]] QString toString() const;
+
+    [[nodiscard]] constexpr bool isNull() const { return m_value == 0; }
+    [[nodiscard]] constexpr bool isOpaque() const { return client() == OPAQUE_CLIENT; }
+    [[nodiscard]] constexpr quint64 raw() const { return m_value; }
+    [[nodiscard]] constexpr quint16 client() const { return static_cast<quint16>(m_value >> COUNTER_BITS); }
+    [[nodiscard]] constexpr quint64 counter() const { return m_value & COUNTER_MASK; }
+
+    friend constexpr bool operator==(ObjectId a, ObjectId b) { return a.m_value == b.m_value; }
+    friend constexpr bool operator!=(ObjectId a, ObjectId b) { return a.m_value != b.m_value; }
+    friend constexpr bool operator<(ObjectId a, ObjectId b) { return a.m_value < b.m_value; }
+
+    // Index of |name| in the process-wide client table, assigning one on first
+    // use. Index 0 is reserved for null ids and returned once the table is full.
+    [[nodiscard]] static quint16 internClient(const QString& name);
+    [[nodiscard]] static QString clientName(quint16 client);
+
+private:
+    static constexpr int COUNTER_BITS = 48;
+    static constexpr quint64 COUNTER_MASK = (quint64(1) << COUNTER_BITS) - 1;
+    // Client of opaque ids; their counter indexes the opaque string table.
+    static constexpr quint16 OPAQUE_CLIENT = 0xffff;
+
+    quint64 m_value = 0;
+};
+
+inline size_t qHash(const ObjectId id, const size_t seed = 0) noexcept {
+    return qHash(id.raw(), seed);
+}
+
+template <>
+struct std::hash<ObjectId> {
+    size_t operator()(const ObjectId id) const noexcept {
+        return std::hash<quint64>()(id.raw());
+    }
+};
@@ -3,6 +3,8 @@
 #include <QString>
 #include <QJsonObject>
 
+#include <Shared/ObjectId.h>
+
 enum class ObjType {
     Line = 1,
     BrokenLine = 2,
@@ -12,7 +14,7 @@ enum class ObjType {
 
 
 struct DrawableObjectData {
-    QString id;
+    ObjectId id;
     ObjType type;
     QJsonObject properties;
     qint64 timestamp = 0;
@@ -5,7 +5,9 @@
 #include <QMainWindow>
 #include <QToolButton>
 
+class BackgroundSaver;
 class CanvasWidget;
+class QProgressBar;
 class QToolBar;
 class QAction;
 class QSpinBox;
@@ -22,21 +24,33 @@ public:
 		return canvas;
 	}
 
+signals:
+	// Bracket a board file replacing the canvas; |ok| is false when the
+	// canvas was left as it was.
+	void boardLoading();
+	void boardLoaded(bool ok);
+
 private slots:
 	void save_as();
 	void upload();
+	void save_progress(qint64 done, qint64 total);
+	void save_finished(const QString& path, bool ok);
 
 	void select();
+	void select_lasso();
 	void choose_color();
 	void change_thickness(int value);
 	void select_tool_line();
 	void select_tool_rectangle();
 	void select_tool_brush();
 	void select_tool_eraser();
+	void select_tool_pixel_eraser();
 	void clear_canvas();
 
 private:
 	CanvasWidget* canvas;
+	BackgroundSaver* saver{};
+	QProgressBar* save_bar{};
 	QToolBar* toolbar{};
 	QColor current_color = Qt::black;
 	int current_thickness = 2;
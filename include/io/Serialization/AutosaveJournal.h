@@ -0,0 +1,68 @@
+﻿#pragma once
+
+#include <QFile>
+#include <QJsonObject>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+
+class BackgroundSaver;
+class CanvasWidget;
+
+// Crash-recovery autosave. Every delta the session applies is appended to
+// journal.log as a length-prefixed CBOR record, so the cost of an edit is the
+// size of the edit. Once the log grows past COMPACT_BYTES, or on a timer, the
+// canvas is written to snapshot.wb in the background while new records go to
+// journal.next.log, which becomes the log once the snapshot is in place.
+// Recovery loads the snapshot and replays whatever log records are left.
+// A board file loaded over the canvas is not logged; a snapshot taken once
+// it is in place covers it. The files are removed on a clean shutdown.
+class AutosaveJournal final : public QObject {
+	Q_OBJECT
+
+public:
+	AutosaveJournal(CanvasWidget* canvas, const QString& directory, QObject* parent = nullptr);
+	~AutosaveJournal() override;
+
+	// Rebuilds the canvas from a journal left behind by a crash. Returns
+	// whether there was anything to recover; starts a fresh log either way.
+	bool recover();
+
+public slots:
+	void append(const QJsonObject& delta);
+	void compact();
+	// Stop and resume logging around a board load, then snapshot the result.
+	void begin_load();
+	void end_load(bool changed);
+
+private slots:
+	void snapshot_written(const QString& path, bool ok);
+
+private:
+	static constexpr qint64 COMPACT_BYTES = 16 * 1024 * 1024;
+	static constexpr int COMPACT_INTERVAL_MS = 5 * 60 * 1000;
+	static constexpr quint32 LOG_MAGIC = 0x57424a31; // "WBJ1"
+
+	CanvasWidget* m_canvas;
+	QString m_directory;
+	BackgroundSaver* m_saver;
+	QTimer m_timer;
+	QFile m_log;
+	qint64 m_log_bytes = 0;
+	bool m_compacting = false;
+	// Set while recovery rebuilds the canvas, whose edits echo back as deltas.
+	bool m_replaying = false;
+	bool m_loading = false;
+	// The canvas holds changes that are in no log, so the next snapshot is
+	// due even while the log is empty.
+	bool m_unlogged = false;
+
+	[[nodiscard]] QString snapshot_path() const;
+	[[nodiscard]] QString log_path() const;
+	[[nodiscard]] QString next_log_path() const;
+
+	bool open_log(const QString& path);
+	// Appends the records of |path| to |deltas|, stopping at a torn tail.
+	static void read_log(const QString& path, QVector<QJsonObject>& deltas);
+};
@@ -0,0 +1,43 @@
+﻿#pragma once
+
+#include <memory>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <utility>
+#include <vector>
+
+class CanvasWidget;
+class DrawableObject;
+
+// Saves boards on a worker thread. save() only copies the list of object
+// handles, which is a valid snapshot since committed objects are never mutated
+// in place; encoding and the disk write then run on the worker, into a
+// temporary file that replaces the target once complete.
+class BackgroundSaver final : public QObject {
+	Q_OBJECT
+
+public:
+	explicit BackgroundSaver(QObject* parent = nullptr);
+	// Finishes the running save and any queued ones before returning.
+	~BackgroundSaver() override;
+
+	// A save requested while another is running starts once that one is done.
+	// Queued saves run in request order, one per path: a later request for a
+	// path already in the queue only replaces its snapshot.
+	void save(const CanvasWidget* canvas, const QString& path);
+	[[nodiscard]] bool busy() const { return m_running; }
+
+signals:
+	void progress(qint64 done, qint64 total);
+	void finished(const QString& path, bool ok);
+
+private:
+	using Snapshot = std::vector<std::shared_ptr<DrawableObject>>;
+
+	QThreadPool m_pool;
+	bool m_running = false;
+	std::vector<std::pair<Snapshot, QString>> m_queued;
+
+	void start(Snapshot snapshot, const QString& path);
+};
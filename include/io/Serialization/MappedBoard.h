@@ -0,0 +1,97 @@
+﻿#pragma once
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <QByteArray>
+#include <QFile>
+#include <QRectF>
+
+#include <DrawingLogic/DrawableObject.h>
+
+// A version 3 board file mapped into memory, so opening it reads only the
+// object table. Objects loaded from it keep their records here until the last
+// of them is gone. Saves replace the file by renaming a new one over it, which
+// leaves the mapped one intact; Windows refuses that rename while the file is
+// mapped, so there release() copies the bytes out and closes the file first.
+class MappedBoard {
+public:
+    [[nodiscard]] static std::shared_ptr<MappedBoard> open(const QString& path);
+    // Lets |path| be replaced: open boards of it stop using the file. A no-op
+    // where a mapped file can be renamed over.
+    static void release(const QString& path);
+
+    MappedBoard(const MappedBoard&) = delete;
+    MappedBoard& operator=(const MappedBoard&) = delete;
+    ~MappedBoard();
+
+    // data() may move on release(); readers hold this shared while using it.
+    [[nodiscard]] std::shared_mutex& mutex() const { return m_mutex; }
+    [[nodiscard]] const uchar* data() const { return m_data; }
+    [[nodiscard]] qint64 size() const { return m_size; }
+
+private:
+    MappedBoard() = default;
+
+    // Copies the mapped bytes into |m_bytes| and closes the file.
+    void detach();
+
+    mutable std::shared_mutex m_mutex;
+    QString m_path;
+    QFile m_file;
+    uchar* m_map = nullptr;
+    QByteArray m_bytes;
+    const uchar* m_data = nullptr;
+    qint64 m_size = 0;
+};
+
+// Stand-in for an object whose record has not been decoded yet. Everything the
+// scene needs up front (id, type, bounds, style) comes from the file's object
+// table; the record is decoded and kept on the first draw, hit test or edit.
+// toJson() decodes it on the side without keeping it; toBin() and
+// toDrawableObjectData() hand the stored bytes on untouched.
+class MappedObject : public DrawableObject {
+public:
+    struct Record {
+        ObjType type = ObjType::Line;
+        QRectF bounds;
+        int thickness = 0;
+        QColor color;
+        qint64 offset = 0;
+        qint64 size = 0;
+    };
+
+    MappedObject(ObjectId id_, const Record& record, std::shared_ptr<const MappedBoard> board);
+
+    [[nodiscard]] ObjType get_type() const override { return m_record.type; }
+
+    void draw(QPainter& painter) const override;
+    void move_by(QPointF delta) override;
+    [[nodiscard]] std::shared_ptr<DrawableObject> clone() const override;
+    [[nodiscard]] QPointF get_end() const override;
+    [[nodiscard]] bool contains_point(QPointF pos, int thickness) const override;
+    [[nodiscard]] bool intersects_segment(QPointF from, QPointF to, int thickness) const override;
+    bool erase_along(QPointF from, QPointF to, int thickness, const std::function<ObjectId()>& make_id,
+        std::vector<std::shared_ptr<DrawableObject>>& parts) const override;
+    [[nodiscard]] QRectF compute_bounds() const override;
+    [[nodiscard]] bool batchable() const override { return m_record.type != ObjType::AssistCircle; }
+    void add_to_batch(RenderBatch& batch) const override;
+
+    QJsonObject toJson() const override;
+    QByteArray toBin() const override;
+    DrawableObjectData toDrawableObjectData() const override;
+
+private:
+    Record m_record;
+    std::shared_ptr<const MappedBoard> m_board;
+    mutable std::once_flag m_decoded;
+    mutable std::shared_ptr<DrawableObject> m_object;
+    // Set once the decoded object has been changed in place; the stored
+    // record is stale from then on.
+    bool m_edited = false;
+
+    // Decodes the record; never null, a damaged record yields an empty stroke.
+    [[nodiscard]] std::shared_ptr<DrawableObject> decode() const;
+    // The decoded object, kept from the first call on. Safe from tile workers.
+    [[nodiscard]] DrawableObject& object() const;
+};
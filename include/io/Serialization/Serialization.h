@@ -1,16 +1,38 @@
 ﻿
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <QString>
+#include <vector>
 
 class CanvasWidget;
+class DrawableObject;
+class QFile;
 
 class CanvasSerializer {
 public:
+    // Receives the number of objects written so far and the total.
+    using Progress = std::function<void(qint64 done, qint64 total)>;
+
     static bool serialize(const CanvasWidget* canvas, const QString& path);
+    // Writes |objects| in z-order. Touches no canvas state, so it can run on a
+    // worker thread over a snapshot of the object list.
+    static bool write(const std::vector<std::shared_ptr<DrawableObject>>& objects, const QString& path,
+        const Progress& progress = {});
     static bool deserialize(CanvasWidget* canvas, const QString& path);
 
 private:
-    static constexpr qint32 FILE_VERSION = 1;
+    // Version 3 adds an object table, so a load only parses the table and
+    // leaves the records to decode on first use; versions 1 and 2 are plain
+    // record streams and still load.
+    static constexpr qint32 FILE_VERSION = 3;
+    static constexpr qint32 MIN_FILE_VERSION = 1;
     static constexpr qint32 MAGIC_NUMBER = 0x43415356;
+    static constexpr qint64 PROGRESS_STEP = 1024;
+
+    static bool deserialize_mapped(CanvasWidget* canvas, const QString& path);
+    // Finds the record boundaries of a version 1 or 2 stream in one pass over
+    // the mapped file, then decodes the records in parallel chunks.
+    static bool deserialize_records(CanvasWidget* canvas, QFile& file, qint32 version);
 };
\ No newline at end of file
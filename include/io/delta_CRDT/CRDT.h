@@ -17,22 +17,29 @@ class DeltaCRDT : public QObject {
 
     mutable QMutex m_mutex;
     QVector<DrawableObjectData> m_objects;          
-    QHash<QString, int> m_idToIndex;
+    QHash<ObjectId, int> m_idToIndex;
 
 public:
 
 	void applyDelta(const QJsonObject& delta);
 
 	QJsonObject generateDelta(const QString operation, const DrawableObjectData& obj = DrawableObjectData());
+	// Adds many objects on top in order, e.g. a loaded board, as a single message.
+	QJsonObject generateCreateBatchDelta(const QVector<DrawableObjectData>& objs);
+	// One delta removing all given objects, so a whole erase gesture travels as a single message.
+	QJsonObject generateDeleteBatchDelta(const QVector<DrawableObjectData>& objs);
+	QJsonObject generateModifyBatchDelta(const QVector<DrawableObjectData>& objs);
+	// Swaps one object for the pieces that survived a partial erase.
+	QJsonObject generateReplaceDelta(ObjectId oldId, const QVector<DrawableObjectData>& parts);
 
 	void updateDrawableObjs();
 
     [[nodiscard]] const QVector<DrawableObjectData>& getObjects() const { return m_objects; }
 
 signals:
-    void objectCreated(const QString& id, const QJsonObject& properties, qint64 timestamp);
-    void objectModified(const QString& id, const QJsonObject& properties, qint64 timestamp);
+    void objectCreated(ObjectId id, const QJsonObject& properties, qint64 timestamp);
+    void objectModified(ObjectId id, const QJsonObject& properties, qint64 timestamp);
     void allObjectsDeleted();
-    void objectDeleted(const QString& id);
+    void objectDeleted(ObjectId id);
     void objectsUpdated(const QVector<DrawableObjectData>& allObjects);
 };
@@ -14,8 +14,12 @@ public:
 public slots:
 
 	void onLocalCreate(const DrawableObjectData& obj);
+	void onLocalCreateBatch(const QVector<DrawableObjectData>& objs);
 	void onLocalModify(const DrawableObjectData& obj);
+	void onLocalModifyBatch(const QVector<DrawableObjectData>& objs);
 	void onLocalDelete(const DrawableObjectData& obj);
+	void onLocalDeleteBatch(const QVector<DrawableObjectData>& objs);
+	void onLocalReplace(ObjectId oldId, const QVector<DrawableObjectData>& parts);
 	void onLocalDeleteAll();
 
 	void onNetworkDelta(const QJsonObject& delta);
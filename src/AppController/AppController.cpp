@@ -1,4 +1,5 @@
-﻿#include <QUuid>
+﻿#include <QStandardPaths>
+#include <QUuid>
 
 #include <AppController/AppController.h>
 #include <DrawingLogic/CanvasWidget.h>
@@ -15,18 +16,27 @@ AppController::AppController(QObject* parent)
     m_clientId = generateClientId();
     m_mainWindow = std::make_unique<MainWindow>(nullptr, m_clientId);
     m_canvasWidget = m_mainWindow->getCanvas();
-
+    m_journal = new AutosaveJournal(m_canvasWidget,
+        QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/autosave", this);
 
     setupConnections();
+    m_journal->recover();
 }
 
 void AppController::setupConnections() {
     connect(m_canvasWidget, &CanvasWidget::objectCreated, this, &AppController::onLocalObjectCreated);
+    connect(m_canvasWidget, &CanvasWidget::objectsCreated, this, &AppController::onLocalObjectsCreated);
     connect(m_canvasWidget, &CanvasWidget::objectModified, this, &AppController::onLocalObjectModified);
+    connect(m_canvasWidget, &CanvasWidget::objectsModified, this, &AppController::onLocalObjectsModified);
     connect(m_canvasWidget, &CanvasWidget::objectDeleted, this, &AppController::onLocalObjectDeleted);
+    connect(m_canvasWidget, &CanvasWidget::objectsDeleted, this, &AppController::onLocalObjectsDeleted);
+    connect(m_canvasWidget, &CanvasWidget::objectReplaced, this, &AppController::onLocalObjectReplaced);
     connect(m_canvasWidget, &CanvasWidget::allObjectsDeleted, this, &AppController::onLocalAllObjectsDeleted);
 
     connect(m_session, &WhiteboardSession::objectsUpdated, this, &AppController::onRemoteObjectsUpdated);
+    connect(m_session, &WhiteboardSession::deltaApplied, m_journal, &AutosaveJournal::append);
+    connect(m_mainWindow.get(), &MainWindow::boardLoading, m_journal, &AutosaveJournal::begin_load);
+    connect(m_mainWindow.get(), &MainWindow::boardLoaded, m_journal, &AutosaveJournal::end_load);
 }
 
 void AppController::start() {
@@ -47,6 +57,15 @@ void AppController::onLocalObjectCreated(std::shared_ptr<DrawableObject> obj) {
     m_session->onLocalCreate(data);
 }
 
+void AppController::onLocalObjectsCreated(std::vector<std::shared_ptr<DrawableObject>> objs) {
+    QVector<DrawableObjectData> data;
+    data.reserve(static_cast<qsizetype>(objs.size()));
+    for (const auto& obj : objs) {
+        data.push_back(obj->toDrawableObjectData());
+    }
+    m_session->onLocalCreateBatch(data);
+}
+
 void AppController::onRemoteObjectsUpdated(const QVector<DrawableObjectData>& objects) {
     if (!m_canvasWidget) {
         qWarning() << "CanvasWidget is null in onRemoteObjectsUpdated";
@@ -73,7 +92,34 @@ void AppController::onLocalObjectModified(std::shared_ptr<DrawableObject> obj) {
     m_session->onLocalModify(data);
 }
 
+void AppController::onLocalObjectsModified(std::vector<std::shared_ptr<DrawableObject>> objs) {
+    QVector<DrawableObjectData> data;
+    data.reserve(static_cast<qsizetype>(objs.size()));
+    for (const auto& obj : objs) {
+        data.push_back(obj->toDrawableObjectData());
+    }
+    m_session->onLocalModifyBatch(data);
+}
+
 void AppController::onLocalObjectDeleted(std::shared_ptr<DrawableObject> obj) {
     DrawableObjectData data = obj->toDrawableObjectData();
     m_session->onLocalDelete(data);
+}
+
+void AppController::onLocalObjectsDeleted(std::vector<std::shared_ptr<DrawableObject>> objs) {
+    QVector<DrawableObjectData> data;
+    data.reserve(static_cast<qsizetype>(objs.size()));
+    for (const auto& obj : objs) {
+        data.push_back(obj->toDrawableObjectData());
+    }
+    m_session->onLocalDeleteBatch(data);
+}
+
+void AppController::onLocalObjectReplaced(std::shared_ptr<DrawableObject> obj, std::vector<std::shared_ptr<DrawableObject>> parts) {
+    QVector<DrawableObjectData> data;
+    data.reserve(static_cast<qsizetype>(parts.size()));
+    for (const auto& part : parts) {
+        data.push_back(part->toDrawableObjectData());
+    }
+    m_session->onLocalReplace(obj->get_id(), data);
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+﻿#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <memory_resource>
+
+#include <DrawingLogic/BatchRenderer.h>
+#include <DrawingLogic/DrawableObject.h>
+
+void BatchRenderer::draw(QPainter& painter, const std::span<const std::shared_ptr<DrawableObject>> objects) {
+	const qreal scale = std::sqrt(std::abs(painter.worldTransform().determinant()));
+	const QRectF clip = painter.hasClipping() ? painter.clipBoundingRect() : QRectF();
+
+	// Batches only live for this call: keep them in a stack arena that spills to
+	// the heap only for unusually fragmented content.
+	std::array<std::byte, SCRATCH_BYTES> scratch;
+	std::pmr::monotonic_buffer_resource arena(scratch.data(), scratch.size());
+	std::pmr::vector<Batch> batches(&arena);
+	batches.reserve(std::min<size_t>(objects.size(), SCRATCH_BYTES / sizeof(Batch)));
+	for (const auto& obj : objects) {
+		const QRectF bounds = obj->bounding_rect();
+
+		if (!obj->batchable() || obj->get_color().alpha() != 255) {
+			Batch single;
+			single.bounds = bounds;
+			single.single = obj;
+			batches.push_back(std::move(single));
+			continue;
+		}
+
+		const StyleKey key{ obj->get_color().rgba(), obj->get_thickness(), obj->get_fill() };
+		Batch* target = nullptr;
+		const size_t lookback = std::min(batches.size(), MAX_LOOKBACK);
+		for (size_t i = 0; i < lookback; ++i) {
+			Batch& candidate = batches[batches.size() - 1 - i];
+			if (!candidate.single && candidate.key == key) {
+				target = &candidate;
+				break;
+			}
+			if (candidate.bounds.intersects(bounds)) {
+				break;
+			}
+		}
+
+		if (!target) {
+			Batch batch;
+			batch.key = key;
+			batch.geometry.scale = scale;
+			batch.geometry.clip = clip;
+			batch.bounds = bounds;
+			batches.push_back(std::move(batch));
+			target = &batches.back();
+		} else {
+			target->bounds |= bounds;
+		}
+		obj->add_to_batch(target->geometry);
+	}
+
+	for (const Batch& batch : batches) {
+		flush(painter, batch);
+	}
+}
+
+void BatchRenderer::flush(QPainter& painter, const Batch& batch) {
+	if (batch.single) {
+		batch.single->draw(painter);
+		return;
+	}
+
+	const RenderBatch& geometry = batch.geometry;
+	painter.setPen(QPen(QColor::fromRgba(batch.key.color), batch.key.thickness));
+	painter.setBrush(Qt::NoBrush);
+	if (!geometry.lines.isEmpty()) {
+		painter.drawLines(geometry.lines.constData(), static_cast<int>(geometry.lines.size()));
+	}
+	if (!geometry.path.isEmpty()) {
+		painter.drawPath(geometry.path);
+	}
+	if (!geometry.rects.isEmpty()) {
+		painter.setBrush(batch.key.fill);
+		painter.drawRects(geometry.rects.constData(), static_cast<int>(geometry.rects.size()));
+	}
+}
@@ -1,20 +1,38 @@
-﻿#include <cmath>
+﻿#include <algorithm>
+#include <cmath>
 #include <QDebug>
 #include <QMouseEvent>
 #include <QPainter>
-#include <unordered_map>
+#include <QScreen>
+#include <unordered_set>
 
+#include <DrawingLogic/BatchRenderer.h>
 #include <DrawingLogic/CanvasWidget.h>
 #include <DrawingLogic/Drawer.h>
 
 CanvasWidget::CanvasWidget(QWidget* parent, const QString& UserId)
-	: QWidget(parent), m_userId(UserId) {
+	: QWidget(parent), m_userId(UserId), m_client(ObjectId::internClient(UserId)) {
 	setMouseTracking(true);
 	create_drawer_by_name("line");
+
+	m_clock.start();
+	m_frame_timer.setSingleShot(true);
+	m_frame_timer.setTimerType(Qt::PreciseTimer);
+	connect(&m_frame_timer, &QTimer::timeout, this, &CanvasWidget::run_frame);
+
+	m_gesture_idle.setSingleShot(true);
+	m_gesture_idle.setInterval(GESTURE_IDLE_MS);
+	connect(&m_gesture_idle, &QTimer::timeout, this, &CanvasWidget::end_gesture);
+
+	connect(&m_rasterizer, &TileRasterizer::tileReady, this, [this](quint64 packed, qreal scale, const QImage& image) {
+		const TileKey key = TileKey::unpack(packed);
+		m_tiles.accept(key, scale, image);
+		schedule_repaint(tile_screen_rect(key));
+	});
 }
 
 const std::vector<std::shared_ptr<DrawableObject>>& CanvasWidget::objects() const {
-	return m_objects;
+	return m_objects.objects();
 }
 
 void CanvasWidget::set_pen_color(const QColor& color) {
@@ -33,6 +51,15 @@ void CanvasWidget::set_pen_thickness(int t) {
 }
 
 void CanvasWidget::set_drawer(std::unique_ptr<Drawer> drawer) {
+	// A tool swapped out mid-gesture must not leave its deletions unreported.
+	while (m_edit_batch_depth > 0) {
+		end_edit_batch();
+	}
+	commit_selection_move();
+	set_selection({});
+	// Queued moves belong to the old tool's gesture.
+	m_pending_moves.clear();
+	m_oldest_input_ns = -1;
 	m_drawer = std::move(drawer);
 	m_drawer->set_color(m_pen_color);
 	m_drawer->set_fill(m_fill);
@@ -51,19 +78,45 @@ void CanvasWidget::create_drawer_by_name(const QString& name) {
 		set_drawer(std::make_unique<RectangleDrawer>());
 	} else if (name == "eraser") {
 		set_drawer(std::make_unique<EraserTool>());
+	} else if (name == "select") {
+		set_drawer(std::make_unique<MoveTool>());
+	} else if (name == "lasso") {
+		set_drawer(std::make_unique<MoveTool>(MoveTool::Mode::Lasso));
+	} else if (name == "pixel_eraser") {
+		set_drawer(std::make_unique<EraserTool>(EraserTool::Mode::Partial));
 	} else {
 		qDebug() << "Unknown tool:" << name;
 	}
 }
 
 void CanvasWidget::clear_all() {
+	m_selection.clear();
+	m_lifted.clear();
+	m_selection_offset = {};
 	m_objects.clear();
-	update();
+	m_index.clear();
+	m_tiles.clear();
+	schedule_repaint(rect());
 	emit allObjectsDeleted();
 }
 
-void CanvasWidget::paintEvent(QPaintEvent*) {
+void CanvasWidget::paintEvent(QPaintEvent* event) {
 	QPainter painter(this);
+	painter.setClipRegion(event->region());
+
+	const QRectF dirty(to_world(event->rect().topLeft()), to_world(event->rect().bottomRight() + QPoint(1, 1)));
+
+	if (in_gesture()) {
+		draw_gesture_frame(painter);
+	} else {
+		draw_tiles(painter, visible_world_rect(), dirty);
+	}
+
+	if (m_grabbing_scene) {
+		m_frame_arena.release();
+		return;
+	}
+
 	painter.setRenderHint(QPainter::Antialiasing);
 
 	QTransform transform;
@@ -71,20 +124,198 @@ void CanvasWidget::paintEvent(QPaintEvent*) {
 	transform.scale(m_scale, m_scale);
 	painter.setTransform(transform);
 
-	for (const auto& obj : m_objects) {
-		obj->draw(painter);
+	if (!m_lifted.empty()) {
+		draw_lifted_selection(painter, dirty);
 	}
 
 	for (const auto& [id, preview] : m_previews) {
-		if (preview) {
+		if (preview && preview->bounding_rect().intersects(dirty)) {
 			preview->draw(painter);
 		}
 	}
 
-	if (m_tool_preview)
+	if (m_tool_preview && m_tool_preview->bounding_rect().intersects(dirty))
 	{
 		m_tool_preview->draw(painter);
 	}
+
+	if (!m_selection.empty()) {
+		painter.resetTransform();
+		const QPen outline(QColor(Qt::darkGray), 1, Qt::DashLine);
+		painter.setPen(outline);
+		painter.setBrush(Qt::NoBrush);
+		painter.drawRect(to_screen(m_selection_bounds.translated(m_selection_offset)));
+	}
+
+	record_presented_frame();
+	m_frame_arena.release();
+}
+
+qint64 CanvasWidget::frame_interval_ns() const {
+	const qreal rate = screen() ? screen()->refreshRate() : 0;
+	return static_cast<qint64>(1e9 / (rate > 0 ? rate : 60.0));
+}
+
+void CanvasWidget::schedule_repaint(const QRect& screen_rect) {
+	m_pending_damage += screen_rect;
+	schedule_frame();
+}
+
+void CanvasWidget::schedule_frame() {
+	// Damage from the moves a frame flushes is presented by that same frame.
+	if (m_frame_timer.isActive() || m_in_frame) return;
+
+	qint64 wait_ns = 0;
+	if (m_last_frame_ns >= 0) {
+		wait_ns = std::max<qint64>(0, m_last_frame_ns + frame_interval_ns() - m_clock.nsecsElapsed());
+	}
+	m_frame_timer.start(static_cast<int>(wait_ns / 1000000));
+}
+
+void CanvasWidget::flush_pending_moves() {
+	if (m_pending_moves.isEmpty() || !m_drawer) return;
+
+	const QVector<QPointF> moves = std::move(m_pending_moves);
+	m_pending_moves.clear();
+	m_drawer->on_mouse_move_batch(this, moves);
+}
+
+void CanvasWidget::run_frame() {
+	m_last_frame_ns = m_clock.nsecsElapsed();
+	const qint64 input_ns = m_oldest_input_ns;
+	m_oldest_input_ns = -1;
+	m_in_frame = true;
+	flush_pending_moves();
+	m_in_frame = false;
+
+	// Input that produced no damage (hovering, an idle tool) never reaches the screen.
+	if (m_pending_damage.isEmpty()) return;
+
+	update(m_pending_damage);
+	m_pending_damage = QRegion();
+	if (m_frame_issued_ns < 0) {
+		m_frame_issued_ns = m_last_frame_ns;
+	}
+	if (input_ns >= 0 && (m_frame_input_ns < 0 || input_ns < m_frame_input_ns)) {
+		m_frame_input_ns = input_ns;
+	}
+}
+
+void CanvasWidget::record_presented_frame() {
+	const qint64 now = m_clock.nsecsElapsed();
+	++m_frame_stats.frames;
+
+	if (m_frame_issued_ns >= 0) {
+		m_frame_stats.dropped_frames += static_cast<quint64>((now - m_frame_issued_ns) / frame_interval_ns());
+		m_frame_issued_ns = -1;
+	}
+
+	if (m_frame_input_ns >= 0) {
+		const qint64 latency_us = (now - m_frame_input_ns) / 1000;
+		FrameStats& stats = m_frame_stats;
+		stats.last_latency_us = latency_us;
+		stats.max_latency_us = std::max(stats.max_latency_us, latency_us);
+		// Exponential moving average over roughly the last 16 frames.
+		stats.average_latency_us += (static_cast<double>(latency_us) - stats.average_latency_us) / 16.0;
+		m_frame_input_ns = -1;
+	}
+}
+
+void CanvasWidget::begin_gesture() {
+	if (!in_gesture()) {
+		m_grabbing_scene = true;
+		m_gesture_frame = grab();
+		m_grabbing_scene = false;
+		m_gesture_offset = m_offset;
+		m_gesture_scale = m_scale;
+	}
+	m_gesture_idle.start();
+}
+
+void CanvasWidget::end_gesture() {
+	if (!in_gesture()) return;
+
+	m_gesture_idle.stop();
+	m_gesture_frame = QPixmap();
+	schedule_repaint(rect());
+}
+
+void CanvasWidget::draw_gesture_frame(QPainter& painter) {
+	painter.save();
+	painter.fillRect(rect(), palette().window());
+
+	// Maps the frame's screen space (old view) into the current view.
+	const qreal ratio = m_scale / m_gesture_scale;
+	painter.translate(m_offset);
+	painter.scale(ratio, ratio);
+	painter.translate(-m_gesture_offset);
+	painter.drawPixmap(QPointF(0, 0), m_gesture_frame);
+	painter.restore();
+}
+
+void CanvasWidget::draw_tiles(QPainter& painter, const QRectF& visible, const QRectF& dirty) {
+	if (m_tiles.set_scale(m_scale, devicePixelRatioF())) {
+		m_rasterizer.cancel_all();
+	}
+
+	std::pmr::vector<TileKey> missing(&m_frame_arena);
+	for (const TileKey& key : m_tiles.tiles_for(dirty)) {
+		if (const QImage* tile = m_tiles.find(key)) {
+			painter.drawImage(TileCache::origin(key) + m_offset, *tile);
+		} else {
+			missing.push_back(key);
+		}
+	}
+
+	if (missing.empty()) {
+		// A partial repaint can be complete while other visible tiles are still
+		// pending, and those keep showing the stretched fallback.
+		if (m_tiles.has_fallback() && m_tiles.has_all(visible)) {
+			m_tiles.drop_fallback();
+		}
+	} else {
+		draw_fallback(painter, missing);
+
+		const QPointF center = visible.center();
+		std::sort(missing.begin(), missing.end(), [&](const TileKey a, const TileKey b) {
+			const QPointF da = m_tiles.world_rect(a).center() - center;
+			const QPointF db = m_tiles.world_rect(b).center() - center;
+			return QPointF::dotProduct(da, da) < QPointF::dotProduct(db, db);
+		});
+		for (const TileKey& key : missing) {
+			if (m_tiles.is_pending(key)) continue;
+
+			m_tiles.mark_pending(key);
+			m_rasterizer.request(key, m_scale, devicePixelRatioF(), tile_snapshot(m_tiles.world_rect(key)));
+		}
+	}
+
+	m_tiles.trim(visible);
+}
+
+void CanvasWidget::draw_fallback(QPainter& painter, const std::span<const TileKey> missing) {
+	QRegion area;
+	QRectF world;
+	for (const TileKey& key : missing) {
+		area += tile_screen_rect(key);
+		world |= m_tiles.world_rect(key);
+	}
+
+	const auto fallback = m_tiles.fallback_for(world);
+	if (fallback.empty()) return;
+
+	painter.save();
+	painter.setClipRegion(area);
+	painter.setRenderHint(QPainter::SmoothPixmapTransform);
+	for (const auto& [rect, image] : fallback) {
+		painter.drawImage(QRectF(to_screen(rect.topLeft()), to_screen(rect.bottomRight())), *image);
+	}
+	painter.restore();
+}
+
+QRect CanvasWidget::tile_screen_rect(const TileKey key) const {
+	const QPointF origin = TileCache::origin(key) + m_offset;
+	return QRectF(origin, QSizeF(TileCache::TILE_SIZE, TileCache::TILE_SIZE)).toAlignedRect();
 }
 
 void CanvasWidget::mousePressEvent(QMouseEvent* event) {
@@ -94,24 +325,29 @@ void CanvasWidget::mousePressEvent(QMouseEvent* event) {
 		return;
 	}
 
+	end_gesture();
 	if (m_drawer) {
+		flush_pending_moves();
 		m_drawer->on_mouse_press(this, to_world(event->pos()));
-		update();
 	}
 }
 
 void CanvasWidget::mouseMoveEvent(QMouseEvent* event) {
 	if (m_panning) {
+		begin_gesture();
 		QPointF delta = event->pos() - m_last_pan_pos;
 		m_offset += delta;
 		m_last_pan_pos = event->pos();
-		update();
+		schedule_repaint(rect());
 		return;
 	}
 
 	if (m_drawer) {
-		m_drawer->on_mouse_move(this, to_world(event->pos()));
-		update();
+		if (m_pending_moves.isEmpty()) {
+			m_oldest_input_ns = m_clock.nsecsElapsed();
+		}
+		m_pending_moves.push_back(to_world(event->pos()));
+		schedule_frame();
 	}
 }
 
@@ -122,14 +358,13 @@ void CanvasWidget::mouseReleaseEvent(QMouseEvent* event) {
 	}
 
 	if (m_drawer) {
+		flush_pending_moves();
 		m_drawer->on_mouse_release(this, to_world(event->pos()));
-		update();
 	}
 }
 
-QString CanvasWidget::generate_id() {
-	m_next_id++;
-	return m_userId + "-" + QString::number(m_next_id);
+ObjectId CanvasWidget::generate_id() {
+	return ObjectId(m_client, ++m_next_id);
 }
 
 QPointF CanvasWidget::to_world(const QPointF& screen_pos) const {
@@ -140,7 +375,29 @@ QPointF CanvasWidget::to_screen(const QPointF& world_pos) const {
 	return world_pos * m_scale + m_offset;
 }
 
+QRectF CanvasWidget::to_screen(const QRectF& world_rect) const {
+	return QRectF(to_screen(world_rect.topLeft()), to_screen(world_rect.bottomRight())).normalized();
+}
+
+void CanvasWidget::damage_world(const QRectF& world_rect) {
+	if (world_rect.isNull()) return;
+	// Pad for antialiasing spill past the geometric bounds.
+	schedule_repaint(to_screen(world_rect).toAlignedRect().adjusted(-2, -2, 2, 2));
+}
+
+void CanvasWidget::damage_object(const std::shared_ptr<DrawableObject>& object) {
+	if (object) {
+		damage_world(object->bounding_rect());
+	}
+}
+
+QRectF CanvasWidget::visible_world_rect() const {
+	return QRectF(to_world(rect().topLeft()), to_world(rect().bottomRight() + QPoint(1, 1)));
+}
+
 void CanvasWidget::wheelEvent(QWheelEvent* event) {
+	begin_gesture();
+
 	const QPointF cursor_pos = event->position();
 	const QPointF before_scale = to_world(cursor_pos);
 
@@ -150,41 +407,265 @@ void CanvasWidget::wheelEvent(QWheelEvent* event) {
 	const QPointF after_scale = to_world(cursor_pos);
 	m_offset += (after_scale - before_scale) * m_scale;
 
-	update();
+	schedule_repaint(rect());
 }
 
 void CanvasWidget::setPreview(QString UserId, std::shared_ptr<DrawableObject> preview){
-	m_previews[UserId] = preview;
+	auto& slot = m_previews[UserId];
+	damage_object(slot);
+	slot = preview;
+	damage_object(slot);
 }
 void CanvasWidget::clearPreview(QString UserId) {
-	m_previews.erase(UserId);
+	auto it = m_previews.find(UserId);
+	if (it == m_previews.end()) return;
+
+	damage_object(it->second);
+	m_previews.erase(it);
 }
 
 void CanvasWidget::clearAllPreviews(){
+	for (const auto& [id, preview] : m_previews) {
+		damage_object(preview);
+	}
 	m_previews.clear();
 }
 
 void CanvasWidget::setToolPreview(std::shared_ptr<DrawableObject> preview) {
+	damage_object(m_tool_preview);
 	m_tool_preview = preview;
+	damage_object(m_tool_preview);
 }
 
 void CanvasWidget::clearToolPreview() {
+	damage_object(m_tool_preview);
 	m_tool_preview = nullptr;
 }
 
 void CanvasWidget::addObject(std::shared_ptr<DrawableObject> obj) {
-	m_objects.push_back(obj);
+	m_index.insert(obj, obj->bounding_rect(), m_objects.append(obj));
+	m_tiles.invalidate(obj->bounding_rect());
+	damage_object(obj);
 
 	emit objectCreated(obj);
 }
 
-bool CanvasWidget::remove_object(const std::shared_ptr<DrawableObject>& object) {
-	auto it = std::find(m_objects.begin(), m_objects.end(), object);
+void CanvasWidget::add_objects(const std::vector<std::shared_ptr<DrawableObject>>& objects) {
+	if (objects.empty()) return;
+
+	QRectF dirty;
+	for (const auto& object : objects) {
+		m_index.insert(object, object->bounding_rect(), m_objects.append(object));
+		dirty |= object->bounding_rect();
+	}
+	m_tiles.invalidate(dirty);
+	damage_world(dirty);
+
+	emit objectsCreated(objects);
+}
 
-	if (it != m_objects.end()) {
-		m_objects.erase(it);
-		emit objectDeleted(object);
+bool CanvasWidget::remove_object(const std::shared_ptr<DrawableObject>& object) {
+	if (const auto slot = slot_of(object.get())) {
+		m_objects.erase(*slot);
+		m_index.remove(object.get());
+		m_tiles.invalidate(object->bounding_rect());
+		damage_object(object);
+		if (m_edit_batch_depth > 0) {
+			m_batched_deletes.push_back(object);
+		} else {
+			emit objectDeleted(object);
+		}
 		return true;
 	}
 	return false;
-}
\ No newline at end of file
+}
+
+size_t CanvasWidget::remove_objects(const std::vector<std::shared_ptr<DrawableObject>>& objects) {
+	std::unordered_set<const DrawableObject*> doomed;
+	std::vector<std::shared_ptr<DrawableObject>> removed;
+	for (const auto& object : objects) {
+		if (object && m_index.remove(object.get())) {
+			doomed.insert(object.get());
+			removed.push_back(object);
+		}
+	}
+	if (removed.empty()) return 0;
+
+	m_objects.erase_if([&](const DrawableObject* object) {
+		return doomed.contains(object);
+	});
+
+	for (const auto& object : removed) {
+		m_tiles.invalidate(object->bounding_rect());
+		damage_object(object);
+	}
+
+	if (m_edit_batch_depth > 0) {
+		m_batched_deletes.insert(m_batched_deletes.end(), removed.begin(), removed.end());
+	} else {
+		emit objectsDeleted(removed);
+	}
+	return removed.size();
+}
+
+std::vector<std::shared_ptr<DrawableObject>> CanvasWidget::objects_in(const QRectF& world_rect) const {
+	return m_index.query(world_rect);
+}
+
+void CanvasWidget::begin_edit_batch() {
+	++m_edit_batch_depth;
+}
+
+void CanvasWidget::end_edit_batch() {
+	if (m_edit_batch_depth == 0 || --m_edit_batch_depth > 0) return;
+
+	if (!m_batched_deletes.empty()) {
+		std::vector<std::shared_ptr<DrawableObject>> removed;
+		removed.swap(m_batched_deletes);
+		emit objectsDeleted(removed);
+	}
+}
+
+bool CanvasWidget::replace_object(const std::shared_ptr<DrawableObject>& object, const std::vector<std::shared_ptr<DrawableObject>>& parts) {
+	if (parts.empty()) {
+		return remove_object(object);
+	}
+
+	const auto slot = slot_of(object.get());
+	if (!slot) {
+		return false;
+	}
+
+	// Each part gets its own z, so overlapping parts keep the cut order.
+	m_index.remove(object.get());
+	const bool kept_z = m_objects.split(*slot, parts);
+	for (size_t i = 0; i < parts.size(); ++i) {
+		m_index.insert(parts[i], parts[i]->bounding_rect(), m_objects.z(*slot + i));
+	}
+	if (!kept_z) {
+		for (size_t i = 0; i < m_objects.size(); ++i) {
+			m_index.set_z(m_objects.object(i).get(), m_objects.z(i));
+		}
+	}
+
+	// The parts never reach outside the original, so its bounds cover all damage.
+	m_tiles.invalidate(object->bounding_rect());
+	damage_object(object);
+	emit objectReplaced(object, parts);
+	return true;
+}
+
+std::optional<size_t> CanvasWidget::slot_of(const DrawableObject* object) const {
+	const auto z = m_index.z_of(object);
+	return z ? m_objects.index_of(object, *z) : std::nullopt;
+}
+
+std::vector<std::shared_ptr<DrawableObject>> CanvasWidget::tile_snapshot(const QRectF& world_rect) const {
+	auto objects = objects_in(world_rect);
+	if (!m_lifted.empty()) {
+		std::erase_if(objects, [this](const std::shared_ptr<DrawableObject>& object) {
+			return m_lifted.contains(object.get());
+		});
+	}
+	return objects;
+}
+
+QRect CanvasWidget::selection_screen_rect() const {
+	return to_screen(m_selection_bounds.translated(m_selection_offset)).toAlignedRect().adjusted(-2, -2, 2, 2);
+}
+
+void CanvasWidget::set_selection(std::vector<std::shared_ptr<DrawableObject>> objects) {
+	commit_selection_move();
+	if (!m_selection.empty()) {
+		schedule_repaint(selection_screen_rect());
+	}
+
+	m_selection = std::move(objects);
+	m_selection_bounds = QRectF();
+	for (const auto& object : m_selection) {
+		m_selection_bounds |= object->bounding_rect();
+	}
+
+	if (!m_selection.empty()) {
+		schedule_repaint(selection_screen_rect());
+	}
+}
+
+void CanvasWidget::begin_selection_move() {
+	if (m_selection.empty() || !m_lifted.empty()) return;
+
+	// Lifted objects leave the tiles and are painted on top with the drag offset.
+	for (const auto& object : m_selection) {
+		m_lifted.insert(object.get());
+		m_tiles.invalidate(object->bounding_rect());
+	}
+	m_selection_offset = {};
+	schedule_repaint(selection_screen_rect());
+}
+
+void CanvasWidget::move_selection_to(const QPointF offset) {
+	if (m_lifted.empty() || offset == m_selection_offset) return;
+
+	schedule_repaint(selection_screen_rect());
+	m_selection_offset = offset;
+	schedule_repaint(selection_screen_rect());
+}
+
+void CanvasWidget::commit_selection_move() {
+	if (m_lifted.empty()) return;
+
+	const QPointF delta = m_selection_offset;
+	m_lifted.clear();
+	m_selection_offset = {};
+
+	if (delta.isNull()) {
+		for (const auto& object : m_selection) {
+			m_tiles.invalidate(object->bounding_rect());
+		}
+		schedule_repaint(selection_screen_rect());
+		return;
+	}
+
+	// Committed objects are shared with render jobs, so each is replaced by a
+	// moved copy.
+	std::vector<std::shared_ptr<DrawableObject>> moved;
+	moved.reserve(m_selection.size());
+	for (const auto& object : m_selection) {
+		const auto slot = slot_of(object.get());
+		if (!slot) continue;
+
+		auto copy = object->clone();
+		copy->move_by(delta);
+		m_objects.replace(*slot, copy);
+		m_index.replace(object.get(), copy, copy->bounding_rect());
+		m_tiles.invalidate(copy->bounding_rect());
+		moved.push_back(std::move(copy));
+	}
+
+	schedule_repaint(to_screen(m_selection_bounds).toAlignedRect().adjusted(-2, -2, 2, 2));
+	schedule_repaint(to_screen(m_selection_bounds.translated(delta)).toAlignedRect().adjusted(-2, -2, 2, 2));
+	m_selection = moved;
+	m_selection_bounds = QRectF();
+	for (const auto& object : m_selection) {
+		m_selection_bounds |= object->bounding_rect();
+	}
+
+	if (!moved.empty()) {
+		emit objectsModified(moved);
+	}
+}
+
+void CanvasWidget::draw_lifted_selection(QPainter& painter, const QRectF& dirty) {
+	const QRectF area = dirty.translated(-m_selection_offset);
+	std::pmr::vector<std::shared_ptr<DrawableObject>> visible(&m_frame_arena);
+	for (const auto& object : m_selection) {
+		if (object->bounding_rect().intersects(area)) {
+			visible.push_back(object);
+		}
+	}
+
+	painter.save();
+	painter.translate(m_selection_offset);
+	BatchRenderer::draw(painter, visible);
+	painter.restore();
+}
@@ -1,8 +1,13 @@
-﻿#include <QIODevice>
+﻿#include <cmath>
+#include <QIODevice>
 #include <QJsonArray>
 #include <utility>
 
+#include <DrawingLogic/BatchRenderer.h>
 #include <DrawingLogic/DrawableObject.h>
+#include <DrawingLogic/Geometry.h>
+#include <DrawingLogic/ObjectPool.h>
+#include <DrawingLogic/StrokeCodec.h>
 
 QString pointFToSerializedString(const QPointF& point) {
     QByteArray byteArray;
@@ -34,17 +39,6 @@ QColor serializedStringToColor(const QString& str) {
     return color;
 }
 
-QJsonArray pointsToJson(const QVector<QPointF>& points) {
-    QJsonArray array;
-    for (const QPointF& point : points) {
-        QJsonObject pt;
-        pt["x"] = point.x();
-        pt["y"] = point.y();
-        array.append(pt);
-    }
-    return array;
-}
-
 QVector<QPointF> jsonToPoints(const QJsonArray& jsonArray) {
     QVector<QPointF> points;
     points.reserve(jsonArray.size());
@@ -74,46 +68,266 @@ void DrawableLine::draw(QPainter& painter) const {
 	painter.drawLine(start, end);
 }
 
+void DrawableLine::add_to_batch(RenderBatch& batch) const {
+	batch.lines.push_back(QLineF(start, end));
+}
+
 void DrawableLine::move_by(const QPointF delta) {
 	start += delta;
 	end += delta;
+	bounds.translate(delta);
 }
 
 std::shared_ptr<DrawableObject> DrawableLine::clone() const {
-	return std::make_shared<DrawableLine>(id, start, end, thickness, color);
+	return make_drawable<DrawableLine>(id, start, end, thickness, color);
 }
 
-DrawableBrokenLine::DrawableBrokenLine(QString id_, const QVector<QPointF>& points_, int thickness_, QColor color_)
-	: DrawableObject(id_, thickness_, std::move(color_)), points(points_) {
+DrawableBrokenLine::DrawableBrokenLine(ObjectId id_, const QVector<QPointF>& points_, int thickness_, QColor color_)
+	: DrawableBrokenLine(id_, stroke_codec::encode(points_, stroke_codec::lossless_fraction_bits(points_)),
+		thickness_, std::move(color_)) {}
+
+DrawableBrokenLine::DrawableBrokenLine(ObjectId id_, QByteArray packed_, int thickness_, QColor color_)
+	: DrawableObject(id_, thickness_, std::move(color_)), packed(std::move(packed_)) {
+	// Paths are built from the decoded samples so they match what hit tests see.
+	if (!stroke_codec::decode(packed, points)) {
+		packed.clear();
+	}
 	rebuild_path();
+	point_count = points.size();
+	last_point = points.empty() ? QPointF() : points.back();
+	points = QVector<QPointF>();
+	index_chunks();
 }
 
 void DrawableBrokenLine::draw(QPainter& painter) const {
 	QPen pen(color, thickness);
 	painter.setPen(pen);
 	painter.setBrush(Qt::NoBrush);
-	painter.drawPath(path);
+
+	if (const QPainterPath* lod = lod_for_scale(std::sqrt(std::abs(painter.worldTransform().determinant())))) {
+		painter.drawPath(*lod);
+	} else {
+		// Visible chunks go out as one path: its stroke is filled once, so the
+		// caps meeting at a seam do not blend twice with a translucent pen.
+		const QRectF clip = painter.hasClipping() ? painter.clipBoundingRect() : QRectF();
+		const qreal m = pen_margin();
+		const PathChunk* first = nullptr;
+		QPainterPath joined;
+		for (const PathChunk& chunk : chunks) {
+			if (!clip.isEmpty() && !chunk.bounds.adjusted(-m, -m, m, m).intersects(clip)) continue;
+			if (!first) {
+				first = &chunk;
+				continue;
+			}
+			if (joined.isEmpty()) {
+				joined = first->path;
+			}
+			joined.addPath(chunk.path);
+		}
+		if (!joined.isEmpty()) {
+			painter.drawPath(joined);
+		} else if (first) {
+			painter.drawPath(first->path);
+		}
+	}
+}
+
+void DrawableBrokenLine::add_to_batch(RenderBatch& batch) const {
+	if (const QPainterPath* lod = lod_for_scale(batch.scale)) {
+		batch.path.addPath(*lod);
+		return;
+	}
+
+	const qreal m = pen_margin();
+	for (const PathChunk& chunk : chunks) {
+		if (batch.clip.isEmpty() || chunk.bounds.adjusted(-m, -m, m, m).intersects(batch.clip)) {
+			batch.path.addPath(chunk.path);
+		}
+	}
 }
 
 void DrawableBrokenLine::move_by(QPointF delta) {
-	for (auto& pt : points) {
-		pt += delta;
+	if (packed.isEmpty()) {
+		for (auto& pt : points) {
+			pt += delta;
+		}
+	} else {
+		// Moved by whole grid steps, the decoded samples shift by exactly the
+		// amount the paths below do, so hit tests and saves keep matching what
+		// is drawn however often the stroke is moved.
+		delta = stroke_codec::snap(delta, stroke_codec::fraction_bits(packed));
+		packed = stroke_codec::translate(packed, delta);
+		index_chunks();
 	}
-	rebuild_path();
+	last_point += delta;
+	for (auto& chunk : chunks) {
+		chunk.path.translate(delta);
+		chunk.bounds.translate(delta);
+	}
+	points_bounds.translate(delta);
+	bounds.translate(delta);
+	for (auto& level : lod_paths) {
+		level.translate(delta);
+	}
+}
+
+QVector<QPointF> DrawableBrokenLine::get_points() const {
+	if (packed.isEmpty()) {
+		return points;
+	}
+	QVector<QPointF> result;
+	stroke_codec::decode(packed, result);
+	return result;
+}
+
+QPointF DrawableBrokenLine::get_end() const {
+	return last_point;
+}
+
+QByteArray DrawableBrokenLine::packed_points() const {
+	return packed.isEmpty() ? stroke_codec::encode(points, stroke_codec::lossless_fraction_bits(points)) : packed;
+}
+
+QRectF DrawableBrokenLine::append_point(const QPointF point) {
+	if (!packed.isEmpty()) {
+		// Growing again: keep the samples expanded until the next commit.
+		stroke_codec::decode(packed, points);
+		packed.clear();
+	}
+	const QPointF previous = points.empty() ? point : points.back();
+	points.push_back(point);
+	point_count = points.size();
+	last_point = point;
+	extend_path(points.size() - 1);
+	update_bounds();
+	lod_paths.clear();
+	lod_tolerances.clear();
+
+	const qreal m = pen_margin();
+	return QRectF(previous, point).normalized().adjusted(-m, -m, m, m);
 }
 
 std::shared_ptr<DrawableObject> DrawableBrokenLine::clone() const {
-	return std::make_shared<DrawableBrokenLine>(id, points, thickness, color);
+	return make_drawable<DrawableBrokenLine>(*this);
 }
 
-void DrawableBrokenLine::rebuild_path() {
-	path = QPainterPath();
+static QPainterPath polyline_path(const QVector<QPointF>& points) {
+	QPainterPath path;
 	if (!points.empty()) {
+		path.reserve(points.size());
 		path.moveTo(points[0]);
-		for (size_t i = 1; i < points.size(); ++i) {
+		for (qsizetype i = 1; i < points.size(); ++i) {
 			path.lineTo(points[i]);
 		}
 	}
+	return path;
+}
+
+static void extend_rect(QRectF& rect, const QPointF point) {
+	rect.setLeft(std::min(rect.left(), point.x()));
+	rect.setRight(std::max(rect.right(), point.x()));
+	rect.setTop(std::min(rect.top(), point.y()));
+	rect.setBottom(std::max(rect.bottom(), point.y()));
+}
+
+void DrawableBrokenLine::rebuild_path() {
+	chunks.clear();
+	points_bounds = QRectF();
+	chunks.reserve(points.size() / CHUNK_POINTS + 1);
+	for (qsizetype i = 0; i < points.size(); ++i) {
+		extend_path(i);
+	}
+	update_bounds();
+	rebuild_lod();
+}
+
+void DrawableBrokenLine::extend_path(const qsizetype index) {
+	const QPointF& point = points[index];
+	if (index == 0) {
+		points_bounds = QRectF(point, QSizeF(0, 0));
+	} else {
+		extend_rect(points_bounds, point);
+	}
+
+	if (chunks.empty() || chunks.back().path.elementCount() >= CHUNK_POINTS) {
+		// A new chunk starts at the previous point so the chunks connect. The
+		// seam gets two caps instead of a join; draw() and batches stroke the
+		// chunks as one path, so the overlap is only covered once.
+		const QPointF start = index > 0 ? points[index - 1] : point;
+		PathChunk chunk;
+		chunk.path.reserve(CHUNK_POINTS);
+		chunk.path.moveTo(start);
+		chunk.bounds = QRectF(start, QSizeF(0, 0));
+		chunks.push_back(std::move(chunk));
+		if (index == 0) return;
+	}
+
+	PathChunk& chunk = chunks.back();
+	chunk.path.lineTo(point);
+	extend_rect(chunk.bounds, point);
+}
+
+void DrawableBrokenLine::index_chunks() {
+	// Chunk k starts at sample k * (CHUNK_POINTS - 1), the last one of chunk k - 1.
+	constexpr qsizetype stride = CHUNK_POINTS - 1;
+	stroke_codec::Reader reader(packed);
+	QPointF point;
+	for (qsizetype i = 0; i < point_count; ++i) {
+		if (i % stride == 0 && i / stride < chunks.size()) {
+			chunks[i / stride].start = reader.cursor();
+		}
+		if (!reader.next(point)) break;
+	}
+}
+
+std::span<const QPointF> DrawableBrokenLine::chunk_points(const qsizetype k,
+	std::array<QPointF, CHUNK_POINTS>& buffer) const {
+	const qsizetype first = k * (CHUNK_POINTS - 1);
+	const qsizetype count = std::min<qsizetype>(chunks[k].path.elementCount(), point_count - first);
+	if (packed.isEmpty()) {
+		return { points.constData() + first, static_cast<size_t>(count) };
+	}
+
+	stroke_codec::Reader reader(packed);
+	reader.seek(chunks[k].start);
+	qsizetype decoded = 0;
+	while (decoded < count && reader.next(buffer[decoded])) {
+		++decoded;
+	}
+	return { buffer.data(), static_cast<size_t>(decoded) };
+}
+
+void DrawableBrokenLine::rebuild_lod() {
+	lod_paths.clear();
+	lod_tolerances.clear();
+	if (points.size() < LOD_MIN_POINTS) return;
+
+	// Tolerances grow fourfold per step; a level is only kept when it drops at
+	// least a quarter of the points of the previous one. Each level simplifies
+	// the previous one by what is left of its budget once the error already
+	// accumulated is taken off, so it stays within |tolerance| of the stroke.
+	QVector<QPointF> level = points;
+	qreal error = 0;
+	for (qreal tolerance = 0.5; level.size() > 2; tolerance *= 4) {
+		QVector<QPointF> coarser = geometry::simplify(level, tolerance - error);
+		if (coarser.size() * 4 > level.size() * 3) continue;
+
+		level = std::move(coarser);
+		error = tolerance;
+		lod_paths.push_back(polyline_path(level));
+		lod_tolerances.push_back(tolerance);
+	}
+}
+
+const QPainterPath* DrawableBrokenLine::lod_for_scale(const qreal scale) const {
+	if (lod_paths.empty() || scale <= 0) return nullptr;
+
+	const qreal tolerance = LOD_SCREEN_TOLERANCE / scale;
+	const QPainterPath* best = nullptr;
+	for (qsizetype i = 0; i < lod_paths.size() && lod_tolerances[i] <= tolerance; ++i) {
+		best = &lod_paths[i];
+	}
+	return best;
 }
 
 void DrawableRectangle::draw(QPainter& painter) const {
@@ -123,74 +337,159 @@ void DrawableRectangle::draw(QPainter& painter) const {
 	painter.drawRect(QRectF(start, end));
 }
 
+void DrawableRectangle::add_to_batch(RenderBatch& batch) const {
+	batch.rects.push_back(QRectF(start, end));
+}
+
 void DrawableRectangle::move_by(const QPointF delta) {
 	start += delta;
 	end += delta;
+	bounds.translate(delta);
 }
 
 std::shared_ptr<DrawableObject> DrawableRectangle::clone() const {
-	return std::make_shared<DrawableRectangle>(id, start, end, thickness, color, fill);
+	return make_drawable<DrawableRectangle>(id, start, end, thickness, color, fill);
 }
 
 bool DrawableLine::contains_point(QPointF pos, int brush_thickness) const {
+    if (outside_bounds(pos, brush_thickness)) return false;
+
     const qreal threshold = (thickness / 2.0) + static_cast<qreal>(brush_thickness);
+    return geometry::distance_to_segment_squared(pos, start, end) <= threshold * threshold;
+}
+
+bool DrawableBrokenLine::contains_point(QPointF pos, int brush_thickness) const {
+    if (chunks.empty() || outside_bounds(pos, brush_thickness)) return false;
+
+    const qreal threshold = (thickness / 2.0) + static_cast<qreal>(brush_thickness);
+
+    // Only chunks whose bounds reach |pos| are decoded.
+    std::array<QPointF, CHUNK_POINTS> buffer;
+    for (qsizetype k = 0; k < chunks.size(); ++k) {
+        if (!chunks[k].bounds.adjusted(-threshold, -threshold, threshold, threshold).contains(pos)) continue;
 
-    const qreal lineLength = QLineF(start, end).length();
-    if (lineLength == 0) {
-        return QLineF(start, pos).length() <= threshold;
+        const std::span<const QPointF> samples = chunk_points(k, buffer);
+        if (geometry::polyline_within(samples.data(), static_cast<qsizetype>(samples.size()), pos, threshold)) {
+            return true;
+        }
     }
+    return false;
+}
 
-    const qreal u = ((pos.x() - start.x()) * (end.x() - start.x()) +
-        (pos.y() - start.y()) * (end.y() - start.y())) /
-        (lineLength * lineLength);
+bool DrawableRectangle::contains_point(QPointF pos, int brush_thickness) const {
+    if (outside_bounds(pos, brush_thickness)) return false;
 
-    const QPointF closest = (u < 0) ? start :
-        (u > 1) ? end :
-        QPointF(start.x() + u * (end.x() - start.x()),
-            start.y() + u * (end.y() - start.y()));
-    return QLineF(pos, closest).length() <= threshold;
+    QRectF rect(start, end);
+    rect = rect.normalized();
+    const qreal threshold = (thickness / 2.0) + static_cast<qreal>(brush_thickness);
+    return rect.adjusted(-threshold, -threshold, threshold, threshold).contains(pos);
 }
 
-bool DrawableBrokenLine::contains_point(QPointF pos, int brush_thickness) const {
-    if (points.empty()) return false;
+bool DrawableObject::intersects_segment(const QPointF from, const QPointF to, const int brush_thickness) const {
+    return contains_point(to, brush_thickness) || contains_point(from, brush_thickness);
+}
+
+bool DrawableLine::intersects_segment(const QPointF from, const QPointF to, const int brush_thickness) const {
+    if (outside_bounds(from, to, brush_thickness)) return false;
 
     const qreal threshold = (thickness / 2.0) + static_cast<qreal>(brush_thickness);
+    return geometry::segment_distance_squared(from, to, start, end) <= threshold * threshold;
+}
 
-    if (points.size() == 1) {
-        return QLineF(points[0], pos).length() <= threshold;
-    }
+bool DrawableBrokenLine::intersects_segment(const QPointF from, const QPointF to, const int brush_thickness) const {
+    if (chunks.empty() || outside_bounds(from, to, brush_thickness)) return false;
 
-    for (size_t i = 1; i < points.size(); ++i) {
-        const QPointF& p1 = points[i - 1];
-        const QPointF& p2 = points[i];
+    const qreal threshold = (thickness / 2.0) + static_cast<qreal>(brush_thickness);
+    const qreal threshold_squared = threshold * threshold;
+
+    if (point_count == 1) {
+        return geometry::distance_to_segment_squared(last_point, from, to) <= threshold_squared;
+    }
 
-        const qreal lineLength = QLineF(p1, p2).length();
-        if (lineLength == 0) {
-            if (QLineF(p1, pos).length() <= threshold) return true;
+    // Only chunks whose bounds meet the sweep are decoded.
+    const QRectF sweep = QRectF(from, to).normalized().adjusted(-threshold, -threshold, threshold, threshold);
+    std::array<QPointF, CHUNK_POINTS> buffer;
+    for (qsizetype k = 0; k < chunks.size(); ++k) {
+        const QRectF& b = chunks[k].bounds;
+        if (b.right() < sweep.left() || b.left() > sweep.right()
+            || b.bottom() < sweep.top() || b.top() > sweep.bottom()) {
             continue;
         }
 
-        const qreal u = ((pos.x() - p1.x()) * (p2.x() - p1.x()) +
-            (pos.y() - p1.y()) * (p2.y() - p1.y())) /
-            (lineLength * lineLength);
-
-        const QPointF closest = (u < 0) ? p1 :
-            (u > 1) ? p2 :
-            QPointF(p1.x() + u * (p2.x() - p1.x()),
-                p1.y() + u * (p2.y() - p1.y()));
-
-        if (QLineF(pos, closest).length() <= threshold) {
-            return true;
+        // Each chunk starts at the last point of the previous one.
+        const std::span<const QPointF> samples = chunk_points(k, buffer);
+        for (size_t i = 1; i < samples.size(); ++i) {
+            if (geometry::segment_distance_squared(from, to, samples[i - 1], samples[i]) <= threshold_squared) {
+                return true;
+            }
         }
     }
     return false;
 }
 
-bool DrawableRectangle::contains_point(QPointF pos, int brush_thickness) const {
-    QRectF rect(start, end);
-    rect = rect.normalized();
+bool DrawableObject::erase_along(const QPointF from, const QPointF to, const int brush_thickness,
+    const std::function<ObjectId()>&, std::vector<std::shared_ptr<DrawableObject>>& parts) const {
+    parts.clear();
+    return intersects_segment(from, to, brush_thickness);
+}
+
+bool DrawableLine::erase_along(const QPointF from, const QPointF to, const int brush_thickness,
+    const std::function<ObjectId()>& make_id, std::vector<std::shared_ptr<DrawableObject>>& parts) const {
+    parts.clear();
+    if (outside_bounds(from, to, brush_thickness)) return false;
+
+    QVector<QVector<QPointF>> pieces;
+    const qreal radius = (thickness / 2.0) + static_cast<qreal>(brush_thickness);
+    if (!geometry::erase_from_polyline({ start, end }, from, to, radius, pieces)) {
+        return false;
+    }
+    for (const auto& piece : pieces) {
+        parts.push_back(make_drawable<DrawableLine>(make_id(), piece.front(), piece.back(), thickness, color));
+    }
+    return true;
+}
+
+bool DrawableBrokenLine::erase_along(const QPointF from, const QPointF to, const int brush_thickness,
+    const std::function<ObjectId()>& make_id, std::vector<std::shared_ptr<DrawableObject>>& parts) const {
+    parts.clear();
+    // The culled test decodes at most a few chunks; the whole stroke is only
+    // unpacked once the brush is known to cut it.
+    if (!intersects_segment(from, to, brush_thickness)) return false;
+
+    QVector<QVector<QPointF>> pieces;
+    const qreal radius = (thickness / 2.0) + static_cast<qreal>(brush_thickness);
+    if (!geometry::erase_from_polyline(get_points(), from, to, radius, pieces)) {
+        return false;
+    }
+    // Parts keep the stroke's precision; the cut ends are rounded to its grid.
+    const int fraction_bits = packed.isEmpty() ? stroke_codec::EXACT_BITS : stroke_codec::fraction_bits(packed);
+    for (const auto& piece : pieces) {
+        parts.push_back(make_drawable<DrawableBrokenLine>(make_id(), stroke_codec::encode(piece, fraction_bits), thickness, color));
+    }
+    return true;
+}
+
+bool DrawableRectangle::intersects_segment(const QPointF from, const QPointF to, const int brush_thickness) const {
+    if (outside_bounds(from, to, brush_thickness)) return false;
+
     const qreal threshold = (thickness / 2.0) + static_cast<qreal>(brush_thickness);
-    return rect.adjusted(-threshold, -threshold, threshold, threshold).contains(pos);
+    const QRectF rect = QRectF(start, end).normalized().adjusted(-threshold, -threshold, threshold, threshold);
+    return geometry::segment_intersects_rect(from, to, rect);
+}
+
+QRectF DrawableLine::compute_bounds() const {
+    const qreal m = pen_margin();
+    return QRectF(start, end).normalized().adjusted(-m, -m, m, m);
+}
+
+QRectF DrawableBrokenLine::compute_bounds() const {
+    const qreal m = pen_margin();
+    return points_bounds.adjusted(-m, -m, m, m);
+}
+
+QRectF DrawableRectangle::compute_bounds() const {
+    const qreal m = pen_margin();
+    return QRectF(start, end).normalized().adjusted(-m, -m, m, m);
 }
 
 // base obj
@@ -201,7 +500,7 @@ QJsonObject DrawableObject::toJson() const {
     inner["color"] = colorToSerializedString(color);
 
     QJsonObject top;
-    top[id] = inner;
+    top[id.toString()] = inner;
     return top;
 }
 
@@ -214,6 +513,18 @@ DrawableObjectData DrawableObject::toDrawableObjectData() const {
 
 std::shared_ptr<DrawableObject> DrawableObject::fromDrawableObjectData(const DrawableObjectData& data) {
     auto type = data.type;
+    // Objects of a loaded board carry their undecoded file record.
+    if (data.properties.contains("record")) {
+        const QByteArray record = QByteArray::fromBase64(data.properties["record"].toString().toLatin1());
+        QDataStream stream(record);
+        qint32 stored = 0;
+        stream >> stored;
+        if (stored != static_cast<qint32>(type)) {
+            qWarning() << "Record does not match obj type:" << static_cast<int>(type);
+            return nullptr;
+        }
+        return fromBin(stream, type);
+    }
     if (type == ObjType::Line) {
         return DrawableLine::fromDrawableObjectData(data);
     }
@@ -227,7 +538,7 @@ std::shared_ptr<DrawableObject> DrawableObject::fromDrawableObjectData(const Dra
     return nullptr;
 }
 
-std::shared_ptr<DrawableObject> DrawableObject::fromJson(const QString id, const ObjType type, const QJsonObject& json) {
+std::shared_ptr<DrawableObject> DrawableObject::fromJson(const ObjectId id, const ObjType type, const QJsonObject& json) {
     if (type == ObjType::Line) {
         return DrawableLine::fromJson(id, json);
     }
@@ -242,12 +553,12 @@ std::shared_ptr<DrawableObject> DrawableObject::fromJson(const QString id, const
     return nullptr;
 }
 
-std::shared_ptr<DrawableObject> DrawableObject::fromBin(QDataStream& stream, ObjType type) {
+std::shared_ptr<DrawableObject> DrawableObject::fromBin(QDataStream& stream, ObjType type, const qint32 version) {
     if (type == ObjType::Line) {
         return DrawableLine::fromBin(stream);
     }
     if (type == ObjType::BrokenLine) {
-        return DrawableBrokenLine::fromBin(stream);
+        return DrawableBrokenLine::fromBin(stream, version);
     }
     if (type == ObjType::Rectangle) {
         return DrawableRectangle::fromBin(stream);
@@ -259,17 +570,18 @@ std::shared_ptr<DrawableObject> DrawableObject::fromBin(QDataStream& stream, Obj
 //line
 QJsonObject DrawableLine::toJson() const {
     QJsonObject json = DrawableObject::toJson();
+    const QString key = id.toString();
 
-    QJsonObject objData = json[id].toObject();
+    QJsonObject objData = json[key].toObject();
     objData["type"] = static_cast<int>(ObjType::Line);
     objData["start"] = pointFToSerializedString(start);
     objData["end"] = pointFToSerializedString(end);
 
-    json[id] = objData;
+    json[key] = objData;
     return json;
 }
 
-std::shared_ptr<DrawableObject> DrawableLine::fromJson(const QString id, const QJsonObject& json) {
+std::shared_ptr<DrawableObject> DrawableLine::fromJson(const ObjectId id, const QJsonObject& json) {
 
     if (!json.contains("start") || !json.contains("end") ||
         !json.contains("thickness") || !json.contains("color")) {
@@ -282,12 +594,12 @@ std::shared_ptr<DrawableObject> DrawableLine::fromJson(const QString id, const Q
     int thickness = json["thickness"].toInt();
     QColor color = serializedStringToColor(json["color"].toString());
 
-    if (id.isEmpty() || thickness <= 0 || !color.isValid()) {
+    if (id.isNull() || thickness <= 0 || !color.isValid()) {
         qWarning() << "Invalid data in line json";
         return nullptr;
     }
 
-    return std::make_shared<DrawableLine>(id, start, end, thickness, color);
+    return make_drawable<DrawableLine>(id, start, end, thickness, color);
 }
 
 QByteArray DrawableLine::toBin() const {
@@ -295,7 +607,7 @@ QByteArray DrawableLine::toBin() const {
     QDataStream stream(&byteArray, QIODevice::WriteOnly);
 
     stream << ObjType::Line;
-    stream << id;
+    stream << id.toString();
     stream << thickness;
     stream << color;
     stream << start;
@@ -305,26 +617,27 @@ QByteArray DrawableLine::toBin() const {
 }
 
 std::shared_ptr<DrawableObject> DrawableLine::fromBin(QDataStream& stream) {
-    QString id;
+    QString id_text;
     int thickness;
     QColor color;
     QPointF start;
     QPointF end;
 
-    stream >> id;
+    stream >> id_text;
+    const ObjectId id = ObjectId::fromString(id_text);
     stream >> thickness;
     stream >> color;
     stream >> start;
     stream >> end;
 
-    return std::make_shared<DrawableLine>(id, start, end, thickness, color);
+    return make_drawable<DrawableLine>(id, start, end, thickness, color);
 }
 
 DrawableObjectData DrawableLine::toDrawableObjectData() const {
     auto json = toJson();
     DrawableObjectData result = DrawableObject::toDrawableObjectData();
     result.type = ObjType::Line;
-    result.properties = json[id].toObject();
+    result.properties = json[id.toString()].toObject();
     return result;
 }
 
@@ -335,31 +648,42 @@ std::shared_ptr<DrawableObject> DrawableLine::fromDrawableObjectData(const Drawa
 //broken line
 QJsonObject DrawableBrokenLine::toJson() const {
     QJsonObject json = DrawableObject::toJson();
+    const QString key = id.toString();
 
-    QJsonObject objData = json[id].toObject();
+    QJsonObject objData = json[key].toObject();
     objData["type"] = static_cast<int>(ObjType::BrokenLine);
-    objData["points"] = pointsToJson(points);
+    objData["packed"] = QString::fromLatin1(packed_points().toBase64());
 
-    json[id] = objData;
+    json[key] = objData;
     return json;
 }
 
-std::shared_ptr<DrawableObject> DrawableBrokenLine::fromJson(const QString id, const QJsonObject& json) {
+std::shared_ptr<DrawableObject> DrawableBrokenLine::fromJson(const ObjectId id, const QJsonObject& json) {
 
-    if (!json.contains("points") || !json.contains("thickness") || !json.contains("color")) {
+    if ((!json.contains("packed") && !json.contains("points")) || !json.contains("thickness") || !json.contains("color")) {
         qWarning() << "Invalid json for broken line: missing fields";
         return nullptr;
     }
 
-    QVector<QPointF> points = jsonToPoints(json["points"].toArray());
     int thickness = json["thickness"].toInt();
     QColor color = serializedStringToColor(json["color"].toString());
+    if (id.isNull() || thickness <= 0 || !color.isValid()) {
+        qWarning() << "Invalid data in broken line json";
+        return nullptr;
+    }
 
-    if (id.isEmpty() || points.empty() || thickness <= 0 || !color.isValid()) {
+    // Deltas from older clients still carry the expanded point list.
+    std::shared_ptr<DrawableBrokenLine> line;
+    if (json.contains("packed")) {
+        line = make_drawable<DrawableBrokenLine>(id, QByteArray::fromBase64(json["packed"].toString().toLatin1()), thickness, color);
+    } else {
+        line = make_drawable<DrawableBrokenLine>(id, jsonToPoints(json["points"].toArray()), thickness, color);
+    }
+    if (line->size() == 0) {
         qWarning() << "Invalid data in broken line json";
         return nullptr;
     }
-    return std::make_shared<DrawableBrokenLine>(id, points, thickness, color);
+    return line;
 }
 
 QByteArray DrawableBrokenLine::toBin() const {
@@ -367,32 +691,44 @@ QByteArray DrawableBrokenLine::toBin() const {
     QDataStream stream(&byteArray, QIODevice::WriteOnly);
 
     stream << ObjType::BrokenLine;
-    stream << id;
+    stream << id.toString();
     stream << thickness;
     stream << color;
-    stream << points;
+    stream << packed_points();
     return byteArray;
 }
 
-std::shared_ptr<DrawableObject> DrawableBrokenLine::fromBin(QDataStream& stream) {
-    QString id;
+std::shared_ptr<DrawableObject> DrawableBrokenLine::fromBin(QDataStream& stream, const qint32 version) {
+    QString id_text;
     int thickness;
     QColor color;
-    QVector<QPointF> points;
 
-    stream >> id;
+    stream >> id_text;
+    const ObjectId id = ObjectId::fromString(id_text);
     stream >> thickness;
     stream >> color;
-    stream >> points;
 
-    return std::make_shared<DrawableBrokenLine>(id, points, thickness, color);
+    if (version < 2) {
+        QVector<QPointF> points;
+        stream >> points;
+        return make_drawable<DrawableBrokenLine>(id, points, thickness, color);
+    }
+
+    QByteArray packed;
+    stream >> packed;
+    auto line = make_drawable<DrawableBrokenLine>(id, std::move(packed), thickness, color);
+    if (line->size() == 0) {
+        qWarning() << "Invalid packed points in broken line record";
+        return nullptr;
+    }
+    return line;
 }
 
 DrawableObjectData DrawableBrokenLine::toDrawableObjectData() const {
     auto json = toJson();
     DrawableObjectData result = DrawableObject::toDrawableObjectData();
     result.type = ObjType::BrokenLine;
-    result.properties = json[id].toObject();
+    result.properties = json[id.toString()].toObject();
     return result;
 }
 
@@ -403,17 +739,18 @@ std::shared_ptr<DrawableObject> DrawableBrokenLine::fromDrawableObjectData(const
 //rectangle
 QJsonObject DrawableRectangle::toJson() const {
     QJsonObject json = DrawableObject::toJson();
+    const QString key = id.toString();
 
-    QJsonObject objData = json[id].toObject();
+    QJsonObject objData = json[key].toObject();
     objData["type"] = static_cast<int>(ObjType::Rectangle);
     objData["start"] = pointFToSerializedString(start);
     objData["end"] = pointFToSerializedString(end);
 
-    json[id] = objData;
+    json[key] = objData;
     return json;
 }
 
-std::shared_ptr<DrawableObject> DrawableRectangle::fromJson(const QString id, const QJsonObject& json) {
+std::shared_ptr<DrawableObject> DrawableRectangle::fromJson(const ObjectId id, const QJsonObject& json) {
     if (!json.contains("start") || !json.contains("end") ||
         !json.contains("thickness") || !json.contains("color")) {
         qWarning() << "Invalid json for rect: missing fields";
@@ -425,11 +762,11 @@ std::shared_ptr<DrawableObject> DrawableRectangle::fromJson(const QString id, co
     int thickness = json["thickness"].toInt();
     QColor color = serializedStringToColor(json["color"].toString());
 
-    if (id.isEmpty() || thickness <= 0 || !color.isValid()) {
+    if (id.isNull() || thickness <= 0 || !color.isValid()) {
         qWarning() << "Invalid data in rect json";
         return nullptr;
     }
-    return std::make_shared<DrawableRectangle>(id, start, end, thickness, color);
+    return make_drawable<DrawableRectangle>(id, start, end, thickness, color);
 }
 
 QByteArray DrawableRectangle::toBin() const {
@@ -437,7 +774,7 @@ QByteArray DrawableRectangle::toBin() const {
     QDataStream stream(&byteArray, QIODevice::WriteOnly);
 
     stream << ObjType::Rectangle;
-    stream << id;
+    stream << id.toString();
     stream << thickness;
     stream << color;
     stream << start;
@@ -447,26 +784,27 @@ QByteArray DrawableRectangle::toBin() const {
 }
 
 std::shared_ptr<DrawableObject> DrawableRectangle::fromBin(QDataStream& stream) {
-    QString id;
+    QString id_text;
     int thickness;
     QColor color;
     QPointF start;
     QPointF end;
 
-    stream >> id;
+    stream >> id_text;
+    const ObjectId id = ObjectId::fromString(id_text);
     stream >> thickness;
     stream >> color;
     stream >> start;
     stream >> end;
 
-    return std::make_shared<DrawableRectangle>(id, start, end, thickness, color);
+    return make_drawable<DrawableRectangle>(id, start, end, thickness, color);
 }
 
 DrawableObjectData DrawableRectangle::toDrawableObjectData() const {
     auto json = toJson();
     DrawableObjectData result = DrawableObject::toDrawableObjectData();
     result.type = ObjType::Rectangle;
-    result.properties = json[id].toObject();
+    result.properties = json[id.toString()].toObject();
     return result;
 }
 
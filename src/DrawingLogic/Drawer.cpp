@@ -1,33 +1,41 @@
 ﻿#include <ranges>
+#include <algorithm>
+#include <QPolygonF>
 #include <utility>
 
 #include <DrawingLogic/CanvasWidget.h>
 #include <DrawingLogic/DrawableObject.h>
 #include <DrawingLogic/Drawer.h>
+#include <DrawingLogic/StrokeCodec.h>
 
 void BrokenLineDrawer::on_mouse_press(CanvasWidget* canvas, const QPointF pos) {
-    m_points.clear();
-    m_points.push_back(pos);
+    preview_path = make_drawable<DrawableBrokenLine>(ObjectId(), QVector<QPointF>{ pos }, thickness, color);
+    fitter = geometry::PolylineFitter(FIT_SCREEN_TOLERANCE / canvas->view_scale());
+    fitter.add(pos);
     m_drawing = true;
+
+	canvas->setPreview(canvas->getUserId(), preview_path);
 }
 
 void BrokenLineDrawer::on_mouse_move(CanvasWidget* canvas, const QPointF pos) {
-	if (!m_drawing) {return;}
-	m_points.push_back(pos);
-	preview_path = std::make_shared<DrawableBrokenLine>("__preview__", m_points, thickness, color);
-
-	canvas->setPreview(canvas->getUserId(), preview_path);
+	if (!m_drawing || !preview_path) {return;}
+	fitter.add(pos);
+	canvas->damage_world(preview_path->append_point(pos));
 }
 
 
 void BrokenLineDrawer::on_mouse_release(CanvasWidget* canvas, const QPointF pos) {
-	if (!m_drawing) {return;}
-	m_points.push_back(pos);
+	if (!m_drawing || !preview_path) {return;}
+	fitter.add(pos);
+	canvas->damage_world(preview_path->append_point(pos));
 
-	QString id = canvas->generate_id();
+	const ObjectId id = canvas->generate_id();
 
-	canvas->addObject(std::make_shared<DrawableBrokenLine>(id, m_points, thickness, color));
+	const int fraction_bits = stroke_codec::fraction_bits_for(PACK_SCREEN_STEP / canvas->view_scale());
+	canvas->addObject(make_drawable<DrawableBrokenLine>(id, stroke_codec::encode(fitter.points(), fraction_bits),
+		thickness, color));
 	m_drawing = false;
+	preview_path.reset();
 	canvas->clearPreview(canvas->getUserId());
 }
 
@@ -37,7 +45,7 @@ void LineDrawer::on_mouse_press(CanvasWidget* canvas, const QPointF pos) {
     start_point = pos;
     end_point = pos;
 
-    preview_line = std::make_shared<DrawableLine>("__preview__", start_point, end_point, thickness, color);
+    preview_line = make_drawable<DrawableLine>(ObjectId(), start_point, end_point, thickness, color);
 	canvas->setPreview(canvas->getUserId(), preview_line);
 }
 
@@ -47,9 +55,10 @@ void LineDrawer::on_mouse_move(CanvasWidget* canvas, const QPointF pos) {
     }
 
     end_point = pos;
-    preview_line = std::make_shared<DrawableLine>("__preview__", start_point, end_point, thickness, color);
-
-	canvas->setPreview(canvas->getUserId(), preview_line);
+    // The preview is only ever drawn on this thread, so it is updated in place.
+    canvas->damage_object(preview_line);
+    preview_line->set_end(end_point);
+    canvas->damage_object(preview_line);
 }
 
 void LineDrawer::on_mouse_release(CanvasWidget* canvas, const QPointF pos) {
@@ -57,8 +66,8 @@ void LineDrawer::on_mouse_release(CanvasWidget* canvas, const QPointF pos) {
     end_point = pos;
 
    
-    QString id = canvas->generate_id();
-	canvas->addObject(std::make_shared<DrawableLine>(id, start_point, end_point, thickness, color));
+    const ObjectId id = canvas->generate_id();
+	canvas->addObject(make_drawable<DrawableLine>(id, start_point, end_point, thickness, color));
 
     m_drawing = false;
     canvas->clearPreview(canvas->getUserId());
@@ -69,7 +78,7 @@ void RectangleDrawer::on_mouse_press(CanvasWidget* canvas, const QPointF pos) {
     start_point = pos;
     end_point = pos;
 
-    preview_rectangle = std::make_shared<DrawableRectangle>("__preview__", start_point, end_point, thickness, color);
+    preview_rectangle = make_drawable<DrawableRectangle>(ObjectId(), start_point, end_point, thickness, color);
 	canvas->setPreview(canvas->getUserId(), preview_rectangle);
 }
 
@@ -77,9 +86,9 @@ void RectangleDrawer::on_mouse_move(CanvasWidget* canvas, const QPointF pos) {
     if (!m_drawing || !preview_rectangle) return;
 
     end_point = pos;
-    preview_rectangle = std::make_shared<DrawableRectangle>("__preview__", start_point, end_point, thickness, color);
-
-	canvas->setPreview(canvas->getUserId(), preview_rectangle);
+    canvas->damage_object(preview_rectangle);
+    preview_rectangle->set_end(end_point);
+    canvas->damage_object(preview_rectangle);
 }
 
 void RectangleDrawer::on_mouse_release(CanvasWidget* canvas, QPointF pos) {
@@ -87,77 +96,222 @@ void RectangleDrawer::on_mouse_release(CanvasWidget* canvas, QPointF pos) {
 
     end_point = pos;
 
-    QString id = canvas->generate_id();
-	canvas->addObject(std::make_shared<DrawableRectangle>(id, start_point, end_point, thickness, color));
+    const ObjectId id = canvas->generate_id();
+	canvas->addObject(make_drawable<DrawableRectangle>(id, start_point, end_point, thickness, color));
 
     m_drawing = false;
 	canvas->clearPreview(canvas->getUserId());
 }
 
 void EraserTool::on_mouse_press(CanvasWidget* canvas, const QPointF pos) {
+	// A second button pressed mid-drag must not open a batch that one release
+	// would leave unclosed.
+	if (is_erasing) return;
 	is_erasing = true;
 	center = pos;
 
-	preview_circle = std::make_shared<DrawableAssistCircle>("__preview__", center, thickness, Qt::black);
+	preview_circle = make_drawable<DrawableAssistCircle>(ObjectId(), center, thickness, Qt::black);
 
 	canvas->setToolPreview(preview_circle);
 
-	erase_at(canvas, pos, thickness);
-	canvas->update();
+	// Everything erased until release is reported to the session as one batch.
+	canvas->begin_edit_batch();
+	erase_along(canvas, { pos }, thickness);
 }
 
 void EraserTool::on_mouse_move(CanvasWidget* canvas, QPointF pos) {
-	if (is_erasing) {
-		center = pos;
-		erase_at(canvas, pos, thickness);
-
-		preview_circle = std::make_shared<DrawableAssistCircle>("__preview__", center, thickness, Qt::black);
-
-		canvas->setToolPreview(preview_circle);
+	on_mouse_move_batch(canvas, { pos });
+}
 
-		canvas->update();
+void EraserTool::on_mouse_move_batch(CanvasWidget* canvas, const QVector<QPointF>& positions) {
+	if (is_erasing && !positions.isEmpty()) {
+		// Sweep from where the brush was last seen so fast drags leave no gaps.
+		QVector<QPointF> path;
+		path.reserve(positions.size() + 1);
+		path.push_back(center);
+		path.append(positions);
+		center = positions.back();
+		erase_along(canvas, path, thickness);
+
+		canvas->damage_object(preview_circle);
+		preview_circle->set_center(center);
+		canvas->damage_object(preview_circle);
 	}
 }
 
 void EraserTool::on_mouse_release(CanvasWidget* canvas, QPointF) {
+	if (is_erasing) {
+		canvas->end_edit_batch();
+	}
 	is_erasing = false;
 
-	auto& objs = canvas->objects();
 	canvas->clearToolPreview();
-
-	canvas->update();
 }
 
 
-void EraserTool::erase_at(CanvasWidget* canvas, QPointF pos, int brush_thickness) {
-	auto& objs = canvas->objects();
+void EraserTool::erase_along(CanvasWidget* canvas, const QVector<QPointF>& path, const int brush_thickness) const {
+	if (path.isEmpty()) return;
+
+	QRectF swept(path.front(), QSizeF(0, 0));
+	for (const QPointF& p : path) {
+		swept.setLeft(std::min(swept.left(), p.x()));
+		swept.setRight(std::max(swept.right(), p.x()));
+		swept.setTop(std::min(swept.top(), p.y()));
+		swept.setBottom(std::max(swept.bottom(), p.y()));
+	}
+	const qreal reach = std::max(brush_thickness, 1);
+	swept = swept.adjusted(-reach, -reach, reach, reach);
+
+	std::vector<std::shared_ptr<DrawableObject>> hits;
+	for (const auto& obj : canvas->objects_in(swept)) {
+		if (mode == Mode::Partial) {
+			std::vector<std::shared_ptr<DrawableObject>> parts;
+			if (!cut(canvas, obj, path, brush_thickness, parts)) continue;
+
+			if (parts.empty()) {
+				hits.push_back(obj);
+			} else {
+				canvas->replace_object(obj, parts);
+			}
+			continue;
+		}
+
+		if (path.size() == 1) {
+			if (obj->contains_point(path.front(), brush_thickness)) {
+				hits.push_back(obj);
+			}
+			continue;
+		}
+		for (qsizetype i = 1; i < path.size(); ++i) {
+			if (obj->intersects_segment(path[i - 1], path[i], brush_thickness)) {
+				hits.push_back(obj);
+				break;
+			}
+		}
+	}
+	canvas->remove_objects(hits);
+}
 
-	for (int i = objs.size() - 1; i >= 0; --i) {
-		if (objs[i]->contains_point(pos, brush_thickness)) {
-			canvas->remove_object(objs[i]);
+bool EraserTool::cut(CanvasWidget* canvas, const std::shared_ptr<DrawableObject>& object,
+	const QVector<QPointF>& path, const int brush_thickness, std::vector<std::shared_ptr<DrawableObject>>& parts) {
+	const auto make_id = [canvas] { return canvas->generate_id(); };
+
+	// Each sweep segment cuts whatever the previous ones left over.
+	bool touched = false;
+	parts = { object };
+	std::vector<std::shared_ptr<DrawableObject>> next;
+	std::vector<std::shared_ptr<DrawableObject>> pieces;
+	// A single sample is a zero-length sweep.
+	const qsizetype segments = std::max<qsizetype>(path.size() - 1, 1);
+	for (qsizetype i = 0; i < segments && !parts.empty(); ++i) {
+		const QPointF from = path[i];
+		const QPointF to = path[std::min(i + 1, path.size() - 1)];
+
+		next.clear();
+		for (const auto& part : parts) {
+			if (part->erase_along(from, to, brush_thickness, make_id, pieces)) {
+				touched = true;
+				next.insert(next.end(), pieces.begin(), pieces.end());
+			} else {
+				next.push_back(part);
+			}
 		}
+		parts.swap(next);
 	}
+	return touched;
 }
 
 void MoveTool::on_mouse_press(CanvasWidget* canvas, QPointF pos) {
-	for (const auto& obj : std::ranges::reverse_view(canvas->objects())) {
-		if (obj->contains_point(pos, thickness)) {
-			selected = obj;
-			last_pos = pos;
-			return;
+	press_pos = pos;
+
+	const auto& selection = canvas->selection();
+	if (!selection.empty() && canvas->selection_bounds().contains(pos)) {
+		dragging = true;
+	} else if (auto hit = object_at(canvas, pos)) {
+		canvas->set_selection({ hit });
+		dragging = true;
+	} else {
+		canvas->set_selection({});
+		selecting = true;
+		if (mode == Mode::Lasso) {
+			lasso = make_drawable<DrawableBrokenLine>(ObjectId(), QVector<QPointF>{ pos }, 1, Qt::darkGray);
+			canvas->setToolPreview(lasso);
+		} else {
+			band = make_drawable<DrawableRectangle>(ObjectId(), pos, pos, 1, Qt::darkGray);
+			canvas->setToolPreview(band);
+		}
+	}
+
+	if (dragging) {
+		canvas->begin_selection_move();
+	}
+}
+
+void MoveTool::on_mouse_move(CanvasWidget* canvas, QPointF pos) {
+	on_mouse_move_batch(canvas, { pos });
+}
+
+void MoveTool::on_mouse_move_batch(CanvasWidget* canvas, const QVector<QPointF>& positions) {
+	if (positions.isEmpty()) return;
+
+	if (dragging) {
+		// The whole group follows the latest position with one offset.
+		canvas->move_selection_to(positions.back() - press_pos);
+	} else if (selecting && mode == Mode::Lasso && lasso) {
+		for (const QPointF& pos : positions) {
+			canvas->damage_world(lasso->append_point(pos));
 		}
+	} else if (selecting && band) {
+		canvas->damage_object(band);
+		band->set_end(positions.back());
+		canvas->damage_object(band);
 	}
-	selected.reset();
 }
 
-void MoveTool::on_mouse_move(CanvasWidget*, QPointF pos) {
-	if (selected) {
-		QPointF delta = pos - last_pos;
-		selected->move_by(delta);
-		last_pos = pos;
+void MoveTool::on_mouse_release(CanvasWidget* canvas, QPointF pos) {
+	if (dragging) {
+		canvas->move_selection_to(pos - press_pos);
+		canvas->commit_selection_move();
+	} else if (selecting) {
+		select_area(canvas, pos);
+		canvas->clearToolPreview();
 	}
+
+	dragging = false;
+	selecting = false;
+	lasso.reset();
+	band.reset();
+}
+
+std::shared_ptr<DrawableObject> MoveTool::object_at(CanvasWidget* canvas, const QPointF pos) const {
+	const QPointF reach(thickness, thickness);
+	const auto candidates = canvas->objects_in(QRectF(pos - reach, pos + reach));
+	for (const auto& obj : std::ranges::reverse_view(candidates)) {
+		if (obj->contains_point(pos, thickness)) {
+			return obj;
+		}
+	}
+	return nullptr;
 }
 
-void MoveTool::on_mouse_release(CanvasWidget*, QPointF) {
-	selected.reset();
+void MoveTool::select_area(CanvasWidget* canvas, const QPointF pos) const {
+	std::vector<std::shared_ptr<DrawableObject>> picked;
+
+	if (mode == Mode::Lasso && lasso) {
+		const QPolygonF polygon(lasso->get_points());
+		for (const auto& obj : canvas->objects_in(polygon.boundingRect())) {
+			if (polygon.containsPoint(obj->bounding_rect().center(), Qt::OddEvenFill)) {
+				picked.push_back(obj);
+			}
+		}
+	} else {
+		const QRectF band = QRectF(press_pos, pos).normalized();
+		for (const auto& obj : canvas->objects_in(band)) {
+			if (band.contains(obj->bounding_rect())) {
+				picked.push_back(obj);
+			}
+		}
+	}
+
+	canvas->set_selection(std::move(picked));
 }
@@ -0,0 +1,436 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WB_GEOMETRY_SSE2 1
+#include <emmintrin.h>
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define WB_GEOMETRY_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+#include <DrawingLogic/Geometry.h>
+
+namespace geometry {
+
+namespace {
+
+// Longest run of points simplify() processes as one Douglas–Peucker problem.
+constexpr qsizetype SIMPLIFY_SPAN = 256;
+
+bool polyline_within_scalar(const qreal* xy, const qsizetype first, const qsizetype count,
+	const QPointF p, const qreal distance_squared) {
+	for (qsizetype i = first; i + 1 < count; ++i) {
+		const QPointF a(xy[2 * i], xy[2 * i + 1]);
+		const QPointF b(xy[2 * i + 2], xy[2 * i + 3]);
+		if (distance_to_segment_squared(p, a, b) <= distance_squared) {
+			return true;
+		}
+	}
+	return false;
+}
+
+#ifdef WB_GEOMETRY_SSE2
+static_assert(std::is_same_v<qreal, double> && sizeof(QPointF) == 2 * sizeof(double),
+	"the SIMD kernels read QPointF arrays as interleaved doubles");
+
+// Two segments per step: lanes hold (x[i], x[i + 1]) against (x[i + 1], x[i + 2]).
+bool polyline_within_sse2(const qreal* xy, const qsizetype count, const QPointF p, const qreal distance_squared) {
+	const __m128d qx = _mm_set1_pd(p.x());
+	const __m128d qy = _mm_set1_pd(p.y());
+	const __m128d limit = _mm_set1_pd(distance_squared);
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d one = _mm_set1_pd(1.0);
+
+	qsizetype i = 0;
+	for (; i + 2 < count; i += 2) {
+		const __m128d p0 = _mm_loadu_pd(xy + 2 * i);
+		const __m128d p1 = _mm_loadu_pd(xy + 2 * i + 2);
+		const __m128d p2 = _mm_loadu_pd(xy + 2 * i + 4);
+		const __m128d ax = _mm_unpacklo_pd(p0, p1);
+		const __m128d ay = _mm_unpackhi_pd(p0, p1);
+		const __m128d dx = _mm_sub_pd(_mm_unpacklo_pd(p1, p2), ax);
+		const __m128d dy = _mm_sub_pd(_mm_unpackhi_pd(p1, p2), ay);
+		const __m128d px = _mm_sub_pd(qx, ax);
+		const __m128d py = _mm_sub_pd(qy, ay);
+
+		const __m128d length_squared = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+		const __m128d dot = _mm_add_pd(_mm_mul_pd(px, dx), _mm_mul_pd(py, dy));
+		// Degenerate segments divide by zero; the mask turns their t into 0.
+		__m128d t = _mm_and_pd(_mm_div_pd(dot, length_squared), _mm_cmpgt_pd(length_squared, zero));
+		t = _mm_min_pd(_mm_max_pd(t, zero), one);
+
+		const __m128d ex = _mm_sub_pd(px, _mm_mul_pd(t, dx));
+		const __m128d ey = _mm_sub_pd(py, _mm_mul_pd(t, dy));
+		const __m128d d = _mm_add_pd(_mm_mul_pd(ex, ex), _mm_mul_pd(ey, ey));
+		if (_mm_movemask_pd(_mm_cmple_pd(d, limit)) != 0) {
+			return true;
+		}
+	}
+	return polyline_within_scalar(xy, i, count, p, distance_squared);
+}
+#endif
+
+#ifdef WB_GEOMETRY_AVX2
+// Four segments per step. The in-lane unpacks pair the points as
+// (i, i + 2, i + 1, i + 3) against (i + 1, i + 3, i + 2, i + 4): the segment
+// order is shuffled, which does not matter for an any-hit test.
+__attribute__((target("avx2")))
+bool polyline_within_avx2(const qreal* xy, const qsizetype count, const QPointF p, const qreal distance_squared) {
+	const __m256d qx = _mm256_set1_pd(p.x());
+	const __m256d qy = _mm256_set1_pd(p.y());
+	const __m256d limit = _mm256_set1_pd(distance_squared);
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d one = _mm256_set1_pd(1.0);
+
+	qsizetype i = 0;
+	for (; i + 4 < count; i += 4) {
+		const __m256d a01 = _mm256_loadu_pd(xy + 2 * i);
+		const __m256d a23 = _mm256_loadu_pd(xy + 2 * i + 4);
+		const __m256d b01 = _mm256_loadu_pd(xy + 2 * i + 2);
+		const __m256d b23 = _mm256_loadu_pd(xy + 2 * i + 6);
+		const __m256d ax = _mm256_unpacklo_pd(a01, a23);
+		const __m256d ay = _mm256_unpackhi_pd(a01, a23);
+		const __m256d dx = _mm256_sub_pd(_mm256_unpacklo_pd(b01, b23), ax);
+		const __m256d dy = _mm256_sub_pd(_mm256_unpackhi_pd(b01, b23), ay);
+		const __m256d px = _mm256_sub_pd(qx, ax);
+		const __m256d py = _mm256_sub_pd(qy, ay);
+
+		const __m256d length_squared = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+		const __m256d dot = _mm256_add_pd(_mm256_mul_pd(px, dx), _mm256_mul_pd(py, dy));
+		__m256d t = _mm256_and_pd(_mm256_div_pd(dot, length_squared),
+			_mm256_cmp_pd(length_squared, zero, _CMP_GT_OQ));
+		t = _mm256_min_pd(_mm256_max_pd(t, zero), one);
+
+		const __m256d ex = _mm256_sub_pd(px, _mm256_mul_pd(t, dx));
+		const __m256d ey = _mm256_sub_pd(py, _mm256_mul_pd(t, dy));
+		const __m256d d = _mm256_add_pd(_mm256_mul_pd(ex, ex), _mm256_mul_pd(ey, ey));
+		if (_mm256_movemask_pd(_mm256_cmp_pd(d, limit, _CMP_LE_OQ)) != 0) {
+			return true;
+		}
+	}
+	return polyline_within_scalar(xy, i, count, p, distance_squared);
+}
+#endif
+
+using PolylineKernel = bool (*)(const qreal*, qsizetype, QPointF, qreal);
+
+PolylineKernel select_polyline_kernel() {
+#ifdef WB_GEOMETRY_AVX2
+	if (__builtin_cpu_supports("avx2")) {
+		return polyline_within_avx2;
+	}
+#endif
+#ifdef WB_GEOMETRY_SSE2
+	return polyline_within_sse2;
+#else
+	return [](const qreal* xy, const qsizetype count, const QPointF p, const qreal distance_squared) {
+		return polyline_within_scalar(xy, 0, count, p, distance_squared);
+	};
+#endif
+}
+
+}
+
+qreal distance_to_segment_squared(const QPointF p, const QPointF a, const QPointF b) {
+	const QPointF ab = b - a;
+	const QPointF ap = p - a;
+	const qreal length_squared = QPointF::dotProduct(ab, ab);
+
+	qreal t = 0;
+	if (length_squared > 0) {
+		t = std::clamp(QPointF::dotProduct(ap, ab) / length_squared, 0.0, 1.0);
+	}
+	const QPointF d = ap - ab * t;
+	return QPointF::dotProduct(d, d);
+}
+
+static qreal cross(const QPointF o, const QPointF a, const QPointF b) {
+	return (a.x() - o.x()) * (b.y() - o.y()) - (a.y() - o.y()) * (b.x() - o.x());
+}
+
+static bool segments_cross(const QPointF a0, const QPointF a1, const QPointF b0, const QPointF b1) {
+	const qreal d1 = cross(b0, b1, a0);
+	const qreal d2 = cross(b0, b1, a1);
+	const qreal d3 = cross(a0, a1, b0);
+	const qreal d4 = cross(a0, a1, b1);
+	return ((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0))
+		&& ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0));
+}
+
+qreal segment_distance_squared(const QPointF a0, const QPointF a1, const QPointF b0, const QPointF b1) {
+	if (segments_cross(a0, a1, b0, b1)) {
+		return 0;
+	}
+	// Touching and collinear cases are covered by the endpoint distances.
+	return std::min({
+		distance_to_segment_squared(a0, b0, b1),
+		distance_to_segment_squared(a1, b0, b1),
+		distance_to_segment_squared(b0, a0, a1),
+		distance_to_segment_squared(b1, a0, a1)
+	});
+}
+
+bool segment_intersects_rect(const QPointF a, const QPointF b, const QRectF& rect) {
+	const QRectF r = rect.normalized();
+	const QPointF d = b - a;
+
+	// Liang-Barsky: clip the parameter range of the segment against each slab.
+	qreal t0 = 0;
+	qreal t1 = 1;
+	const qreal p[4] = { -d.x(), d.x(), -d.y(), d.y() };
+	const qreal q[4] = { a.x() - r.left(), r.right() - a.x(), a.y() - r.top(), r.bottom() - a.y() };
+	for (int i = 0; i < 4; ++i) {
+		if (p[i] == 0) {
+			if (q[i] < 0) return false;
+			continue;
+		}
+		const qreal t = q[i] / p[i];
+		if (p[i] < 0) {
+			t0 = std::max(t0, t);
+		} else {
+			t1 = std::min(t1, t);
+		}
+		if (t0 > t1) return false;
+	}
+	return true;
+}
+
+bool polyline_within(const QPointF* points, const qsizetype count, const QPointF p, const qreal distance) {
+	if (count <= 0) return false;
+
+	const qreal distance_squared = distance * distance;
+	if (count == 1) {
+		const QPointF d = points[0] - p;
+		return QPointF::dotProduct(d, d) <= distance_squared;
+	}
+
+	static const PolylineKernel kernel = select_polyline_kernel();
+	return kernel(reinterpret_cast<const qreal*>(points), count, p, distance_squared);
+}
+
+namespace {
+
+struct Interval {
+	qreal lo = 0;
+	qreal hi = 1;
+	[[nodiscard]] bool empty() const { return lo > hi; }
+};
+
+// Narrows |range| to the t where alpha + beta * t <= 0.
+void clip_linear(Interval& range, const qreal alpha, const qreal beta) {
+	if (beta == 0) {
+		if (alpha > 0) range = { 1, 0 };
+		return;
+	}
+	const qreal t = -alpha / beta;
+	if (beta > 0) {
+		range.hi = std::min(range.hi, t);
+	} else {
+		range.lo = std::max(range.lo, t);
+	}
+}
+
+// Parameters t in [0, 1] where a + t * (b - a) lies within |radius| of |c|.
+Interval circle_interval(const QPointF a, const QPointF b, const QPointF c, const qreal radius) {
+	const QPointF e = b - a;
+	const QPointF f = a - c;
+	const qreal qa = QPointF::dotProduct(e, e);
+	const qreal qb = 2 * QPointF::dotProduct(f, e);
+	const qreal qc = QPointF::dotProduct(f, f) - radius * radius;
+	if (qa == 0) {
+		return qc <= 0 ? Interval{ 0, 1 } : Interval{ 1, 0 };
+	}
+	const qreal disc = qb * qb - 4 * qa * qc;
+	if (disc < 0) {
+		return { 1, 0 };
+	}
+	const qreal root = std::sqrt(disc);
+	return { std::max<qreal>(0, (-qb - root) / (2 * qa)), std::min<qreal>(1, (-qb + root) / (2 * qa)) };
+}
+
+// Parameters t in [0, 1] where a + t * (b - a) lies within |radius| of the
+// capsule core [from, to]. The capsule is convex, so this is the hull of the
+// intervals of its two end discs and of its middle slab.
+Interval capsule_interval(const QPointF a, const QPointF b, const QPointF from, const QPointF to, const qreal radius) {
+	Interval result = circle_interval(a, b, from, radius);
+	auto merge = [&result](const Interval& other) {
+		if (other.empty()) return;
+		if (result.empty()) {
+			result = other;
+		} else {
+			result = { std::min(result.lo, other.lo), std::max(result.hi, other.hi) };
+		}
+	};
+	merge(circle_interval(a, b, to, radius));
+
+	const QPointF d = to - from;
+	const qreal length_squared = QPointF::dotProduct(d, d);
+	if (length_squared > 0) {
+		const QPointF e = b - a;
+		const QPointF f = a - from;
+		// Projection onto the core stays within [0, |d|^2] ...
+		const qreal u0 = QPointF::dotProduct(f, d);
+		const qreal u1 = QPointF::dotProduct(e, d);
+		// ... and the offset from the core line stays within radius * |d|.
+		const qreal v0 = f.x() * d.y() - f.y() * d.x();
+		const qreal v1 = e.x() * d.y() - e.y() * d.x();
+		const qreal w = radius * std::sqrt(length_squared);
+
+		Interval slab;
+		clip_linear(slab, -u0, -u1);
+		clip_linear(slab, u0 - length_squared, u1);
+		clip_linear(slab, v0 - w, v1);
+		clip_linear(slab, -v0 - w, -v1);
+		merge(slab);
+	}
+	return result;
+}
+
+QPointF lerp(const QPointF a, const QPointF b, const qreal t) {
+	return a + (b - a) * t;
+}
+
+}
+
+bool erase_from_polyline(const QVector<QPointF>& points, const QPointF from, const QPointF to, const qreal radius,
+	QVector<QVector<QPointF>>& pieces) {
+	pieces.clear();
+	if (points.isEmpty()) return false;
+
+	if (points.size() == 1) {
+		return distance_to_segment_squared(points[0], from, to) <= radius * radius;
+	}
+
+	const qreal left = std::min(from.x(), to.x()) - radius;
+	const qreal right = std::max(from.x(), to.x()) + radius;
+	const qreal top = std::min(from.y(), to.y()) - radius;
+	const qreal bottom = std::max(from.y(), to.y()) + radius;
+
+	bool cut = false;
+	QVector<QPointF> current;
+	auto close_current = [&] {
+		if (current.size() >= 2) {
+			pieces.push_back(std::move(current));
+		}
+		current.clear();
+	};
+
+	for (qsizetype i = 1; i < points.size(); ++i) {
+		const QPointF a = points[i - 1];
+		const QPointF b = points[i];
+
+		Interval erased{ 1, 0 };
+		const bool apart = std::max(a.x(), b.x()) < left || std::min(a.x(), b.x()) > right
+			|| std::max(a.y(), b.y()) < top || std::min(a.y(), b.y()) > bottom;
+		if (!apart) {
+			erased = capsule_interval(a, b, from, to, radius);
+		}
+
+		// A tangent brush touches the segment in a single point; nothing to cut.
+		if (erased.empty() || erased.hi - erased.lo <= std::numeric_limits<qreal>::epsilon()) {
+			if (current.isEmpty()) current.push_back(a);
+			current.push_back(b);
+			continue;
+		}
+
+		cut = true;
+		if (erased.lo > 0) {
+			if (current.isEmpty()) current.push_back(a);
+			current.push_back(lerp(a, b, erased.lo));
+		}
+		close_current();
+		if (erased.hi < 1) {
+			current = { lerp(a, b, erased.hi), b };
+		}
+	}
+	close_current();
+	if (!cut) pieces.clear();
+	return cut;
+}
+
+QVector<QPointF> simplify(const QVector<QPointF>& points, const qreal tolerance) {
+	if (points.size() < 3 || tolerance <= 0) {
+		return points;
+	}
+
+	const qreal tolerance_squared = tolerance * tolerance;
+	std::vector<bool> keep(points.size(), false);
+	keep.front() = true;
+	keep.back() = true;
+
+	// Spans end on kept points, so they simplify independently and each costs
+	// at most SIMPLIFY_SPAN^2 distance checks.
+	std::vector<std::pair<qsizetype, qsizetype>> stack;
+	for (qsizetype first = 0; first < points.size() - 1; first += SIMPLIFY_SPAN) {
+		const qsizetype last = std::min(first + SIMPLIFY_SPAN, points.size() - 1);
+		keep[last] = true;
+		stack.emplace_back(first, last);
+	}
+
+	while (!stack.empty()) {
+		const auto [first, last] = stack.back();
+		stack.pop_back();
+
+		qreal max_distance = 0;
+		qsizetype farthest = -1;
+		for (qsizetype i = first + 1; i < last; ++i) {
+			const qreal d = distance_to_segment_squared(points[i], points[first], points[last]);
+			if (d > max_distance) {
+				max_distance = d;
+				farthest = i;
+			}
+		}
+
+		if (farthest >= 0 && max_distance > tolerance_squared) {
+			keep[farthest] = true;
+			stack.emplace_back(first, farthest);
+			stack.emplace_back(farthest, last);
+		}
+	}
+
+	QVector<QPointF> result;
+	for (qsizetype i = 0; i < points.size(); ++i) {
+		if (keep[i]) {
+			result.push_back(points[i]);
+		}
+	}
+	return result;
+}
+
+PolylineFitter::PolylineFitter(const qreal tolerance)
+	: m_tolerance_squared(tolerance * tolerance) {}
+
+void PolylineFitter::add(const QPointF point) {
+	if (m_vertices.isEmpty()) {
+		m_vertices.push_back(point);
+		return;
+	}
+
+	const QPointF anchor = m_vertices.back();
+	bool covered = m_run.size() < MAX_RUN;
+	for (qsizetype i = 0; covered && i < m_run.size(); ++i) {
+		covered = distance_to_segment_squared(m_run[i], anchor, point) <= m_tolerance_squared;
+	}
+	if (!covered) {
+		// The previous sample is the farthest the current segment could reach.
+		m_vertices.push_back(m_run.back());
+		m_run.clear();
+	}
+	m_run.push_back(point);
+}
+
+QVector<QPointF> PolylineFitter::points() const {
+	QVector<QPointF> result = m_vertices;
+	if (!m_run.isEmpty()) {
+		result.push_back(m_run.back());
+	}
+	return result;
+}
+
+}
@@ -0,0 +1,8 @@
+﻿#include <DrawingLogic/ObjectPool.h>
+
+std::pmr::memory_resource* scene_memory() {
+	// Intentionally never destroyed: objects may still be released by queued
+	// jobs while static destructors run.
+	static auto* pool = new std::pmr::synchronized_pool_resource();
+	return pool;
+}
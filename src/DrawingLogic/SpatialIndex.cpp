@@ -0,0 +1,193 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <DrawingLogic/DrawableObject.h>
+#include <DrawingLogic/SpatialIndex.h>
+
+namespace {
+
+qint32 to_cell(const qreal coord, const qreal cell_size) {
+	const qreal cell = std::floor(coord / cell_size);
+	constexpr qreal lo = std::numeric_limits<qint32>::min() / 2;
+	constexpr qreal hi = std::numeric_limits<qint32>::max() / 2;
+	return static_cast<qint32>(std::clamp(cell, lo, hi));
+}
+
+}
+
+SpatialIndex::SpatialIndex(const qreal cell_size)
+	: m_cell_size(cell_size) {}
+
+quint64 SpatialIndex::cell_key(const qint32 x, const qint32 y) {
+	return (static_cast<quint64>(static_cast<quint32>(x)) << 32) | static_cast<quint32>(y);
+}
+
+SpatialIndex::CellRange SpatialIndex::cells_for(const QRectF& rect) const {
+	const QRectF r = rect.normalized();
+	return {
+		to_cell(r.left(), m_cell_size),
+		to_cell(r.top(), m_cell_size),
+		to_cell(r.right(), m_cell_size),
+		to_cell(r.bottom(), m_cell_size)
+	};
+}
+
+void SpatialIndex::link(const DrawableObject* object, Entry& entry) {
+	const CellRange range = cells_for(entry.bounds);
+	entry.oversized = range.count() > MAX_CELLS_PER_OBJECT;
+
+	if (entry.oversized) {
+		m_oversized.push_back(object);
+		return;
+	}
+
+	for (qint32 x = range.left; x <= range.right; ++x) {
+		for (qint32 y = range.top; y <= range.bottom; ++y) {
+			m_cells[cell_key(x, y)].push_back(object);
+		}
+	}
+}
+
+void SpatialIndex::unlink(const DrawableObject* object, const Entry& entry) {
+	auto erase_from = [object](std::vector<const DrawableObject*>& list) {
+		auto it = std::find(list.begin(), list.end(), object);
+		if (it != list.end()) {
+			*it = list.back();
+			list.pop_back();
+		}
+	};
+
+	if (entry.oversized) {
+		erase_from(m_oversized);
+		return;
+	}
+
+	const CellRange range = cells_for(entry.bounds);
+	for (qint32 x = range.left; x <= range.right; ++x) {
+		for (qint32 y = range.top; y <= range.bottom; ++y) {
+			auto cell = m_cells.find(cell_key(x, y));
+			if (cell == m_cells.end()) continue;
+
+			erase_from(cell->second);
+			if (cell->second.empty()) {
+				m_cells.erase(cell);
+			}
+		}
+	}
+}
+
+void SpatialIndex::insert(const std::shared_ptr<DrawableObject>& object, const QRectF& bounds, const quint64 z) {
+	if (!object) return;
+	remove(object.get());
+
+	Entry& entry = m_entries[object.get()];
+	entry.object = object;
+	entry.bounds = bounds.normalized();
+	entry.z = z;
+	link(object.get(), entry);
+}
+
+bool SpatialIndex::remove(const DrawableObject* object) {
+	auto it = m_entries.find(object);
+	if (it == m_entries.end()) {
+		return false;
+	}
+	unlink(object, it->second);
+	m_entries.erase(it);
+	return true;
+}
+
+bool SpatialIndex::replace(const DrawableObject* old_object, const std::shared_ptr<DrawableObject>& object, const QRectF& bounds) {
+	auto it = m_entries.find(old_object);
+	if (it == m_entries.end() || !object) {
+		return false;
+	}
+	const quint64 z = it->second.z;
+	remove(old_object);
+	insert(object, bounds, z);
+	return true;
+}
+
+void SpatialIndex::update(const DrawableObject* object, const QRectF& bounds) {
+	auto it = m_entries.find(object);
+	if (it == m_entries.end()) {
+		return;
+	}
+	unlink(object, it->second);
+	it->second.bounds = bounds.normalized();
+	link(object, it->second);
+}
+
+void SpatialIndex::set_z(const DrawableObject* object, const quint64 z) {
+	auto it = m_entries.find(object);
+	if (it != m_entries.end()) {
+		it->second.z = z;
+	}
+}
+
+void SpatialIndex::clear() {
+	m_cells.clear();
+	m_entries.clear();
+	m_oversized.clear();
+}
+
+bool SpatialIndex::contains(const DrawableObject* object) const {
+	return m_entries.contains(object);
+}
+
+std::optional<quint64> SpatialIndex::z_of(const DrawableObject* object) const {
+	auto it = m_entries.find(object);
+	if (it == m_entries.end()) {
+		return std::nullopt;
+	}
+	return it->second.z;
+}
+
+std::vector<std::shared_ptr<DrawableObject>> SpatialIndex::query(const QRectF& rect) const {
+	std::vector<const Entry*> hits;
+	const QRectF area = rect.normalized();
+
+	auto collect = [&](const std::vector<const DrawableObject*>& list) {
+		for (const DrawableObject* object : list) {
+			const Entry& entry = m_entries.at(object);
+			if (entry.bounds.intersects(area)) {
+				hits.push_back(&entry);
+			}
+		}
+	};
+
+	const CellRange range = cells_for(area);
+	if (range.count() > static_cast<qint64>(m_cells.size())) {
+		// The query covers more cells than are populated: walk the populated ones.
+		for (const auto& [key, list] : m_cells) {
+			const auto x = static_cast<qint32>(key >> 32);
+			const auto y = static_cast<qint32>(key & 0xffffffffu);
+			if (x >= range.left && x <= range.right && y >= range.top && y <= range.bottom) {
+				collect(list);
+			}
+		}
+	} else {
+		for (qint32 x = range.left; x <= range.right; ++x) {
+			for (qint32 y = range.top; y <= range.bottom; ++y) {
+				auto cell = m_cells.find(cell_key(x, y));
+				if (cell != m_cells.end()) {
+					collect(cell->second);
+				}
+			}
+		}
+	}
+	collect(m_oversized);
+
+	std::sort(hits.begin(), hits.end(), [](const Entry* a, const Entry* b) {
+		return a->z != b->z ? a->z < b->z : a < b;
+	});
+	hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+
+	std::vector<std::shared_ptr<DrawableObject>> result;
+	result.reserve(hits.size());
+	for (const Entry* entry : hits) {
+		result.push_back(entry->object);
+	}
+	return result;
+}
@@ -0,0 +1,234 @@
+﻿#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <QDebug>
+#include <QtEndian>
+
+#include <DrawingLogic/StrokeCodec.h>
+
+namespace stroke_codec {
+
+namespace {
+
+// Keeps quantized coordinates far from the int64 limits so deltas cannot overflow.
+constexpr qreal MAX_FIXED = 4503599627370496.0; // 2^52
+
+quint64 zigzag(const qint64 value) {
+	return (static_cast<quint64>(value) << 1) ^ static_cast<quint64>(value >> 63);
+}
+
+qint64 unzigzag(const quint64 value) {
+	return static_cast<qint64>(value >> 1) ^ -static_cast<qint64>(value & 1);
+}
+
+void put_varint(QByteArray& out, quint64 value) {
+	while (value >= 0x80) {
+		out.append(static_cast<char>((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	out.append(static_cast<char>(value));
+}
+
+bool get_varint(const uchar*& it, const uchar* end, quint64& value) {
+	value = 0;
+	for (int shift = 0; shift < 64 && it != end; shift += 7) {
+		const uchar byte = *it++;
+		value |= static_cast<quint64>(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) return true;
+	}
+	return false;
+}
+
+void put_double(QByteArray& out, const qreal value) {
+	uchar bytes[8];
+	qToLittleEndian(std::bit_cast<quint64>(value), bytes);
+	out.append(reinterpret_cast<const char*>(bytes), 8);
+}
+
+qint64 to_fixed(const qreal value, const qreal scale) {
+	const qreal scaled = std::isfinite(value) ? value * scale : 0.0;
+	return std::llround(std::clamp(scaled, -MAX_FIXED, MAX_FIXED));
+}
+
+QByteArray encode_exact(const QVector<QPointF>& points) {
+	QByteArray out;
+	out.reserve(8 + points.size() * 16);
+	out.append(static_cast<char>(EXACT_BITS));
+	put_varint(out, static_cast<quint64>(points.size()));
+	for (const QPointF& point : points) {
+		put_double(out, point.x());
+		put_double(out, point.y());
+	}
+	return out;
+}
+
+}
+
+QByteArray encode(const QVector<QPointF>& points, int fraction_bits) {
+	if (fraction_bits == EXACT_BITS) {
+		return encode_exact(points);
+	}
+	fraction_bits = std::clamp(fraction_bits, 0, MAX_FRACTION_BITS);
+	const qreal scale = static_cast<qreal>(1 << fraction_bits);
+
+	QByteArray out;
+	// Most deltas fit in one byte per coordinate; the rest is amortized growth.
+	out.reserve(8 + points.size() * 2);
+	out.append(static_cast<char>(fraction_bits));
+	put_varint(out, static_cast<quint64>(points.size()));
+
+	qint64 x = 0;
+	qint64 y = 0;
+	for (const QPointF& point : points) {
+		const qint64 qx = to_fixed(point.x(), scale);
+		const qint64 qy = to_fixed(point.y(), scale);
+		put_varint(out, zigzag(qx - x));
+		put_varint(out, zigzag(qy - y));
+		x = qx;
+		y = qy;
+	}
+	return out;
+}
+
+bool decode(const QByteArray& data, QVector<QPointF>& points) {
+	points.clear();
+	if (data.isEmpty()) return false;
+
+	Reader reader(data);
+	if (!reader.valid()) {
+		qWarning() << "Malformed packed stroke";
+		return false;
+	}
+
+	points.reserve(reader.count());
+	QPointF point;
+	while (points.size() < reader.count() && reader.next(point)) {
+		points.append(point);
+	}
+	if (points.size() < reader.count()) {
+		qWarning() << "Truncated packed stroke";
+		points.clear();
+		return false;
+	}
+	return true;
+}
+
+int fraction_bits_for(const qreal step) {
+	if (!(step > 0) || !std::isfinite(step)) return EXACT_BITS;
+	const int bits = std::max(0, static_cast<int>(std::ceil(-std::log2(step))));
+	return bits > MAX_FRACTION_BITS ? EXACT_BITS : bits;
+}
+
+int lossless_fraction_bits(const QVector<QPointF>& points) {
+	int bits = 0;
+	qreal largest = 0;
+	const auto fits = [&](const qreal value) {
+		if (!std::isfinite(value)) return false;
+		while (std::ldexp(value, bits) != std::trunc(std::ldexp(value, bits))) {
+			if (++bits > MAX_FRACTION_BITS) return false;
+		}
+		largest = std::max(largest, std::abs(value));
+		return true;
+	};
+	for (const QPointF& point : points) {
+		if (!fits(point.x()) || !fits(point.y())) return EXACT_BITS;
+	}
+	return std::ldexp(largest, bits) <= MAX_FIXED ? bits : EXACT_BITS;
+}
+
+int fraction_bits(const QByteArray& data) {
+	if (data.isEmpty()) return 0;
+	const int bits = static_cast<uchar>(data[0]);
+	return bits == EXACT_BITS ? EXACT_BITS : std::min(bits, MAX_FRACTION_BITS);
+}
+
+QPointF snap(const QPointF point, int fraction_bits) {
+	if (fraction_bits == EXACT_BITS) return point;
+	fraction_bits = std::clamp(fraction_bits, 0, MAX_FRACTION_BITS);
+	const qreal scale = static_cast<qreal>(1 << fraction_bits);
+	return QPointF(static_cast<qreal>(to_fixed(point.x(), scale)) / scale,
+		static_cast<qreal>(to_fixed(point.y(), scale)) / scale);
+}
+
+QByteArray translate(const QByteArray& data, const QPointF delta) {
+	if (fraction_bits(data) == EXACT_BITS) {
+		QVector<QPointF> points;
+		if (!decode(data, points)) return data;
+		for (QPointF& point : points) {
+			point += delta;
+		}
+		return encode_exact(points);
+	}
+
+	Reader reader(data);
+	const qsizetype header_end = reader.cursor().offset;
+	QPointF first;
+	if (!reader.valid() || !reader.next(first)) {
+		return data;
+	}
+	const Cursor rest = reader.cursor();
+
+	const qreal scale = static_cast<qreal>(1 << fraction_bits(data));
+	QByteArray out;
+	out.reserve(data.size() + 4);
+	out.append(data.constData(), header_end);
+	put_varint(out, zigzag(rest.x + to_fixed(delta.x(), scale)));
+	put_varint(out, zigzag(rest.y + to_fixed(delta.y(), scale)));
+	out.append(data.constData() + rest.offset, data.size() - rest.offset);
+	return out;
+}
+
+Reader::Reader(const QByteArray& data) {
+	if (data.isEmpty()) return;
+
+	m_begin = reinterpret_cast<const uchar*>(data.constData());
+	m_it = m_begin;
+	m_end = m_begin + data.size();
+
+	const int fraction_bits = *m_it++;
+	m_exact = fraction_bits == EXACT_BITS;
+	quint64 count = 0;
+	// Every point takes at least two bytes, which bounds a corrupt count.
+	if ((fraction_bits > MAX_FRACTION_BITS && !m_exact) || !get_varint(m_it, m_end, count)
+		|| count > static_cast<quint64>(m_end - m_it) / (m_exact ? 16 : 2)) {
+		m_it = m_end;
+		return;
+	}
+	m_step = m_exact ? 1.0 : 1.0 / static_cast<qreal>(1 << fraction_bits);
+	m_count = static_cast<qsizetype>(count);
+	m_valid = true;
+}
+
+Cursor Reader::cursor() const {
+	return { m_it - m_begin, static_cast<qint64>(m_x), static_cast<qint64>(m_y) };
+}
+
+void Reader::seek(const Cursor& cursor) {
+	if (!m_valid) return;
+	m_it = m_begin + std::clamp<qsizetype>(cursor.offset, 0, m_end - m_begin);
+	m_x = static_cast<quint64>(cursor.x);
+	m_y = static_cast<quint64>(cursor.y);
+}
+
+bool Reader::next(QPointF& point) {
+	if (m_exact) {
+		if (m_end - m_it < 16) return false;
+		point = QPointF(std::bit_cast<qreal>(qFromLittleEndian<quint64>(m_it)),
+			std::bit_cast<qreal>(qFromLittleEndian<quint64>(m_it + 8)));
+		m_it += 16;
+		return true;
+	}
+
+	quint64 dx = 0;
+	quint64 dy = 0;
+	if (!get_varint(m_it, m_end, dx) || !get_varint(m_it, m_end, dy)) {
+		return false;
+	}
+	m_x += static_cast<quint64>(unzigzag(dx));
+	m_y += static_cast<quint64>(unzigzag(dy));
+	point = QPointF(static_cast<qreal>(static_cast<qint64>(m_x)) * m_step,
+		static_cast<qreal>(static_cast<qint64>(m_y)) * m_step);
+	return true;
+}
+
+}
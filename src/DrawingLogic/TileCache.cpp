@@ -0,0 +1,198 @@
+﻿#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <QPainter>
+
+#include <DrawingLogic/BatchRenderer.h>
+#include <DrawingLogic/TileCache.h>
+
+namespace {
+
+qint32 to_tile(const qreal scaled_coord) {
+	const qreal tile = std::floor(scaled_coord / TileCache::TILE_SIZE);
+	constexpr qreal lo = std::numeric_limits<qint32>::min() / 2;
+	constexpr qreal hi = std::numeric_limits<qint32>::max() / 2;
+	return static_cast<qint32>(std::clamp(tile, lo, hi));
+}
+
+}
+
+bool TileCache::set_scale(const qreal scale, const qreal device_pixel_ratio) {
+	if (scale == m_scale && device_pixel_ratio == m_dpr) {
+		return false;
+	}
+	if (!m_tiles.empty()) {
+		m_previous = std::move(m_tiles);
+		m_previous_scale = m_scale;
+	}
+	m_scale = scale;
+	m_dpr = device_pixel_ratio;
+	m_tiles.clear();
+	m_pending.clear();
+	return true;
+}
+
+void TileCache::erase_intersecting(std::unordered_map<quint64, QImage>& tiles, const qreal scale, const QRectF& world_rect) {
+	for (auto it = tiles.begin(); it != tiles.end();) {
+		if (TileCache::world_rect(TileKey::unpack(it->first), scale).intersects(world_rect)) {
+			it = tiles.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void TileCache::invalidate(const QRectF& world_rect) {
+	for (auto& [key, stale] : m_pending) {
+		if (!stale && this->world_rect(TileKey::unpack(key)).intersects(world_rect)) {
+			stale = true;
+		}
+	}
+	if (!m_previous.empty()) {
+		erase_intersecting(m_previous, m_previous_scale, world_rect);
+	}
+	if (m_tiles.empty()) return;
+
+	// A rect covering more tiles than are cached is cheaper to match by scan.
+	const TileRange range = tile_range(world_rect);
+	if (range.count() > m_tiles.size()) {
+		erase_intersecting(m_tiles, m_scale, world_rect);
+		return;
+	}
+	for (qint32 y = range.top; y <= range.bottom; ++y) {
+		for (qint32 x = range.left; x <= range.right; ++x) {
+			m_tiles.erase(TileKey{ x, y }.pack());
+		}
+	}
+}
+
+void TileCache::clear() {
+	m_tiles.clear();
+	m_previous.clear();
+	for (auto& [key, stale] : m_pending) {
+		stale = true;
+	}
+}
+
+void TileCache::trim(const QRectF& keep) {
+	if (m_tiles.size() <= MAX_TILES) return;
+
+	for (auto it = m_tiles.begin(); it != m_tiles.end();) {
+		if (!world_rect(TileKey::unpack(it->first)).intersects(keep)) {
+			it = m_tiles.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+TileCache::TileRange TileCache::tile_range(const QRectF& world_rect) const {
+	if (m_scale <= 0) return {};
+
+	const QRectF r = world_rect.normalized();
+	return { to_tile(r.left() * m_scale), to_tile(r.top() * m_scale),
+		to_tile(r.right() * m_scale), to_tile(r.bottom() * m_scale) };
+}
+
+std::vector<TileKey> TileCache::tiles_for(const QRectF& world_rect) const {
+	const TileRange range = tile_range(world_rect);
+	std::vector<TileKey> keys;
+	keys.reserve(static_cast<size_t>(range.count()));
+	for (qint32 y = range.top; y <= range.bottom; ++y) {
+		for (qint32 x = range.left; x <= range.right; ++x) {
+			keys.push_back({ x, y });
+		}
+	}
+	return keys;
+}
+
+QRectF TileCache::world_rect(const TileKey key) const {
+	return world_rect(key, m_scale);
+}
+
+QRectF TileCache::world_rect(const TileKey key, const qreal scale) {
+	const qreal size = TILE_SIZE / scale;
+	return QRectF(key.x * size, key.y * size, size, size);
+}
+
+QPointF TileCache::origin(const TileKey key) {
+	return QPointF(static_cast<qreal>(key.x) * TILE_SIZE, static_cast<qreal>(key.y) * TILE_SIZE);
+}
+
+const QImage* TileCache::find(const TileKey key) const {
+	auto it = m_tiles.find(key.pack());
+	return it == m_tiles.end() ? nullptr : &it->second;
+}
+
+bool TileCache::has_all(const QRectF& world_rect) const {
+	const TileRange range = tile_range(world_rect);
+	if (range.count() > m_tiles.size()) return false;
+	for (qint32 y = range.top; y <= range.bottom; ++y) {
+		for (qint32 x = range.left; x <= range.right; ++x) {
+			if (!m_tiles.contains(TileKey{ x, y }.pack())) return false;
+		}
+	}
+	return true;
+}
+
+void TileCache::mark_pending(const TileKey key) {
+	m_pending[key.pack()] = false;
+}
+
+bool TileCache::is_pending(const TileKey key) const {
+	return m_pending.contains(key.pack());
+}
+
+bool TileCache::accept(const TileKey key, const qreal scale, QImage image) {
+	if (scale != m_scale) {
+		return false;
+	}
+	auto it = m_pending.find(key.pack());
+	if (it == m_pending.end()) {
+		return false;
+	}
+	const bool stale = it->second;
+	m_pending.erase(it);
+	if (stale) {
+		return false;
+	}
+	m_tiles[key.pack()] = std::move(image);
+	return true;
+}
+
+std::vector<std::pair<QRectF, const QImage*>> TileCache::fallback_for(const QRectF& world_rect) const {
+	std::vector<std::pair<QRectF, const QImage*>> result;
+	for (const auto& [key, image] : m_previous) {
+		const QRectF rect = TileCache::world_rect(TileKey::unpack(key), m_previous_scale);
+		if (rect.intersects(world_rect)) {
+			result.emplace_back(rect, &image);
+		}
+	}
+	return result;
+}
+
+void TileCache::drop_fallback() {
+	m_previous.clear();
+	m_previous_scale = 0;
+}
+
+QImage TileCache::rasterize(const TileKey key, const qreal scale, const qreal device_pixel_ratio,
+	const std::vector<std::shared_ptr<DrawableObject>>& objects) {
+	const int pixels = static_cast<int>(std::ceil(TILE_SIZE * device_pixel_ratio));
+	QImage image(pixels, pixels, QImage::Format_ARGB32_Premultiplied);
+	image.setDevicePixelRatio(device_pixel_ratio);
+	image.fill(Qt::transparent);
+
+	QPainter painter(&image);
+	painter.setRenderHint(QPainter::Antialiasing);
+	painter.setClipRect(QRectF(0, 0, TILE_SIZE, TILE_SIZE));
+
+	const QPointF tile_origin = origin(key);
+	QTransform transform;
+	transform.translate(-tile_origin.x(), -tile_origin.y());
+	transform.scale(scale, scale);
+	painter.setTransform(transform);
+
+	BatchRenderer::draw(painter, objects);
+	return image;
+}
@@ -0,0 +1,41 @@
+﻿#include <algorithm>
+#include <QMetaObject>
+#include <QRunnable>
+#include <QThread>
+
+#include <DrawingLogic/DrawableObject.h>
+#include <DrawingLogic/TileRasterizer.h>
+
+TileRasterizer::TileRasterizer(QObject* parent)
+	: QObject(parent), m_generation(std::make_shared<std::atomic<quint64>>(0)) {
+	m_pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount()));
+}
+
+TileRasterizer::~TileRasterizer() {
+	cancel_all();
+	m_pool.waitForDone();
+}
+
+void TileRasterizer::request(const TileKey key, const qreal scale, const qreal device_pixel_ratio,
+	std::vector<std::shared_ptr<DrawableObject>> snapshot) {
+	const quint64 generation = m_generation->load();
+
+	m_pool.start(QRunnable::create(
+		[this, key, scale, device_pixel_ratio, generation, counter = m_generation, objects = std::move(snapshot)] {
+			if (counter->load() != generation) return;
+
+			QImage image = TileCache::rasterize(key, scale, device_pixel_ratio, objects);
+			if (counter->load() != generation) return;
+
+			QMetaObject::invokeMethod(this, [this, key, scale, generation, counter, image = std::move(image)] {
+				if (counter->load() == generation) {
+					emit tileReady(key.pack(), scale, image);
+				}
+			}, Qt::QueuedConnection);
+		}));
+}
+
+void TileRasterizer::cancel_all() {
+	m_pool.clear();
+	m_generation->fetch_add(1);
+}
@@ -0,0 +1,71 @@
+﻿#include <algorithm>
+
+#include <DrawingLogic/DrawableObject.h>
+#include <DrawingLogic/ZOrderList.h>
+
+quint64 ZOrderList::append(std::shared_ptr<DrawableObject> object) {
+	const quint64 z = m_next_z;
+	m_next_z += Z_STEP;
+	m_objects.push_back(std::move(object));
+	m_z.push_back(z);
+	return z;
+}
+
+bool ZOrderList::split(const size_t pos, const std::vector<std::shared_ptr<DrawableObject>>& parts) {
+	const quint64 z = m_z[pos];
+	const quint64 limit = pos + 1 < m_z.size() ? m_z[pos + 1] : m_next_z;
+
+	const auto at = static_cast<std::ptrdiff_t>(pos);
+	m_objects.erase(m_objects.begin() + at);
+	m_z.erase(m_z.begin() + at);
+	m_objects.insert(m_objects.begin() + at, parts.begin(), parts.end());
+
+	if (limit - z < parts.size()) {
+		m_z.insert(m_z.begin() + at, parts.size(), 0);
+		renumber();
+		return false;
+	}
+
+	const quint64 step = (limit - z) / parts.size();
+	std::vector<quint64> zs(parts.size());
+	for (size_t i = 0; i < parts.size(); ++i) {
+		zs[i] = z + i * step;
+	}
+	m_z.insert(m_z.begin() + at, zs.begin(), zs.end());
+	return true;
+}
+
+void ZOrderList::replace(const size_t pos, std::shared_ptr<DrawableObject> object) {
+	m_objects[pos] = std::move(object);
+}
+
+void ZOrderList::erase(const size_t pos) {
+	const auto at = static_cast<std::ptrdiff_t>(pos);
+	m_objects.erase(m_objects.begin() + at);
+	m_z.erase(m_z.begin() + at);
+}
+
+void ZOrderList::clear() {
+	m_objects.clear();
+	m_z.clear();
+	m_next_z = 0;
+}
+
+std::optional<size_t> ZOrderList::index_of(const DrawableObject* object, const quint64 z) const {
+	const auto it = std::lower_bound(m_z.begin(), m_z.end(), z);
+	if (it == m_z.end() || *it != z) {
+		return std::nullopt;
+	}
+	const auto i = static_cast<size_t>(it - m_z.begin());
+	if (m_objects[i].get() != object) {
+		return std::nullopt;
+	}
+	return i;
+}
+
+void ZOrderList::renumber() {
+	for (size_t i = 0; i < m_z.size(); ++i) {
+		m_z[i] = i * Z_STEP;
+	}
+	m_next_z = m_z.size() * Z_STEP;
+}
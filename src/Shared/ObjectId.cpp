@@ -0,0 +1,98 @@
+﻿#include <QDebug>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+
+#include <Shared/ObjectId.h>
+
+namespace {
+
+struct ClientTable {
+    QMutex mutex;
+    QHash<QString, quint16> indices;
+    QVector<QString> names{ QString() };
+    // Opaque ids by counter; entry 0 is unused so no opaque id is null.
+    QHash<QString, quint64> opaque_indices;
+    QVector<QString> opaque{ QString() };
+};
+
+ClientTable& clients() {
+    static ClientTable table;
+    return table;
+}
+
+}
+
+ObjectId::ObjectId(const quint16 client, const quint64 counter)
+    : m_value((static_cast<quint64>(client) << COUNTER_BITS) | (counter & COUNTER_MASK)) {
+    if (counter > COUNTER_MASK) {
+        qWarning() << "Object counter overflows" << COUNTER_BITS << "bits:" << counter;
+    }
+}
+
+quint16 ObjectId::internClient(const QString& name) {
+    ClientTable& table = clients();
+    QMutexLocker locker(&table.mutex);
+
+    auto it = table.indices.constFind(name);
+    if (it != table.indices.constEnd()) {
+        return it.value();
+    }
+    if (table.names.size() >= OPAQUE_CLIENT) {
+        return 0;
+    }
+    const auto index = static_cast<quint16>(table.names.size());
+    table.names.append(name);
+    table.indices.insert(name, index);
+    return index;
+}
+
+QString ObjectId::clientName(const quint16 client) {
+    ClientTable& table = clients();
+    QMutexLocker locker(&table.mutex);
+    return client < table.names.size() ? table.names[client] : QString();
+}
+
+ObjectId ObjectId::fromString(const QString& text) {
+    if (text.isEmpty()) {
+        return ObjectId();
+    }
+
+    const qsizetype dash = text.lastIndexOf(QChar('-'));
+    if (dash > 0) {
+        const QString digits = text.mid(dash + 1);
+        bool ok = false;
+        const quint64 counter = digits.toULongLong(&ok);
+        // Only the form toString() produces, so the text comes back unchanged.
+        if (ok && counter > 0 && counter <= COUNTER_MASK && digits == QString::number(counter)) {
+            if (const quint16 client = internClient(text.left(dash)); client != 0) {
+                return ObjectId(client, counter);
+            }
+        }
+    }
+
+    ClientTable& table = clients();
+    QMutexLocker locker(&table.mutex);
+    if (auto it = table.opaque_indices.constFind(text); it != table.opaque_indices.constEnd()) {
+        return ObjectId(OPAQUE_CLIENT, it.value());
+    }
+    const auto index = static_cast<quint64>(table.opaque.size());
+    if (index > COUNTER_MASK) {
+        qFatal("Opaque id table is full");
+    }
+    table.opaque.append(text);
+    table.opaque_indices.insert(text, index);
+    return ObjectId(OPAQUE_CLIENT, index);
+}
+
+QString ObjectId::toString() const {
+    if (isNull()) {
+        return QString();
+    }
+    if (isOpaque()) {
+        ClientTable& table = clients();
+        QMutexLocker locker(&table.mutex);
+        return counter() < static_cast<quint64>(table.opaque.size()) ? table.opaque[counter()] : QString();
+    }
+    return clientName(client()) + "-" + QString::number(counter());
+}
@@ -2,7 +2,9 @@
 #include <QColorDialog>
 #include <QFileDialog>
 #include <QMenu>
+#include <QProgressBar>
 #include <QSpinBox>
+#include <QStatusBar>
 #include <QToolBar>
 #include <QToolButton>
 #include <QMessageBox>
@@ -10,6 +12,7 @@
 #include <DrawingLogic/CanvasWidget.h>
 #include <DrawingLogic/Drawer.h>
 #include <UI/MainWindow.h>
+#include <io/Serialization/BackgroundSaver.h>
 #include <io/Serialization/Serialization.h>
 
 MainWindow::MainWindow(QWidget *parent,const QString& clientId)
@@ -19,6 +22,15 @@ MainWindow::MainWindow(QWidget *parent,const QString& clientId)
     canvas = new CanvasWidget(this, clientId);
     setCentralWidget(canvas);
     setup_toolbar();
+
+    saver = new BackgroundSaver(this);
+    connect(saver, &BackgroundSaver::progress, this, &MainWindow::save_progress);
+    connect(saver, &BackgroundSaver::finished, this, &MainWindow::save_finished);
+
+    save_bar = new QProgressBar(this);
+    save_bar->setMaximumWidth(200);
+    save_bar->setVisible(false);
+    statusBar()->addPermanentWidget(save_bar);
 }
 
 MainWindow::~MainWindow() = default;
@@ -75,10 +87,12 @@ QToolButton* MainWindow::setup_tools_button() {
     };
 
     addToolAction("Select", &MainWindow::select);
+    addToolAction("Lasso", &MainWindow::select_lasso);
     addToolAction("Line", &MainWindow::select_tool_line);
     addToolAction("Rectangle", &MainWindow::select_tool_rectangle);
     addToolAction("Brush", &MainWindow::select_tool_brush);
     addToolAction("Eraser", &MainWindow::select_tool_eraser);
+    addToolAction("Pixel eraser", &MainWindow::select_tool_pixel_eraser);
 
     tool_button->setMenu(tool_menu);
     return tool_button;
@@ -93,12 +107,25 @@ void MainWindow::save_as() {
     );
 
     if (!filename.isEmpty()) {
-        if (CanvasSerializer::serialize(canvas, filename)) {
-            QMessageBox::information(this, "Success", "File saved successfully");
-        }
-        else {
-            QMessageBox::warning(this, "Error", "Failed to save file");
-        }
+        statusBar()->showMessage("Saving " + filename + "...");
+        saver->save(canvas, filename);
+    }
+}
+
+void MainWindow::save_progress(const qint64 done, const qint64 total) {
+    save_bar->setRange(0, 1000);
+    save_bar->setValue(total > 0 ? static_cast<int>(done * 1000 / total) : 1000);
+    save_bar->setVisible(true);
+}
+
+void MainWindow::save_finished(const QString& path, const bool ok) {
+    save_bar->setVisible(false);
+    if (ok) {
+        statusBar()->showMessage("Saved " + path, 5000);
+    }
+    else {
+        statusBar()->clearMessage();
+        QMessageBox::warning(this, "Error", "Failed to save file");
     }
 }
 
@@ -111,7 +138,10 @@ void MainWindow::upload() {
     );
 
     if (!filename.isEmpty()) {
-        if (CanvasSerializer::deserialize(canvas, filename)) {
+        emit boardLoading();
+        const bool ok = CanvasSerializer::deserialize(canvas, filename);
+        emit boardLoaded(ok);
+        if (ok) {
             QMessageBox::information(this, "Success", "File loaded successfully");
             canvas->update();
         }
@@ -129,6 +159,13 @@ void MainWindow::select() {
     canvas->set_drawer(std::move(tool));
 }
 
+void MainWindow::select_lasso() {
+    auto tool = std::make_unique<MoveTool>(MoveTool::Mode::Lasso);
+    tool->set_thickness(current_thickness);
+    tool->set_color(current_color);
+    canvas->set_drawer(std::move(tool));
+}
+
 void MainWindow::choose_color() {
     QColor selected = QColorDialog::getColor(current_color, this);
     if (selected.isValid()) {
@@ -168,6 +205,12 @@ void MainWindow::select_tool_eraser() {
     canvas->set_drawer(std::move(tool));
 }
 
+void MainWindow::select_tool_pixel_eraser() {
+    auto tool = std::make_unique<EraserTool>(EraserTool::Mode::Partial);
+    tool->set_thickness(current_thickness);
+    canvas->set_drawer(std::move(tool));
+}
+
 void MainWindow::change_thickness(int value) {
     current_thickness = value;
     if (canvas) {
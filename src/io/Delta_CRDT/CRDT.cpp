@@ -1,4 +1,5 @@
-﻿#include <QJsonObject>
+﻿#include <QJsonArray>
+#include <QJsonObject>
 
 #include <io/Delta_CRDT/CRDT.h>
 #include <Shared/Shared.h>
@@ -13,6 +14,37 @@
   "timestamp": 1692100005000
 }
 
+{
+  "action": "createBatch",
+  "objects": [
+	{ "id": id, "data": { obj full data } }, ...
+  ],
+  "timestamp": 1692100005000
+}
+
+{
+  "action": "deleteBatch",
+  "ids": [ id, ... ],
+  "timestamp": 1692100005000
+}
+
+{
+  "action": "modifyBatch",
+  "objects": {
+	id : { obj full data }, ...
+  },
+  "timestamp": 1692100005000
+}
+
+{
+  "action": "replace",
+  "id": id of the replaced obj,
+  "parts": [
+	{ "id": part id, "data": { obj full data } }, ...
+  ],
+  "timestamp": 1692100005000
+}
+
 */
 
 void DeltaCRDT::applyDelta(const QJsonObject& delta) {
@@ -32,16 +64,129 @@ void DeltaCRDT::applyDelta(const QJsonObject& delta) {
 		return;
 	}
 
+	if (action == "deleteBatch") {
+		QSet<ObjectId> ids;
+		for (const auto& id : delta.value("ids").toArray()) {
+			ids.insert(ObjectId::fromString(id.toString()));
+		}
+		if (ids.isEmpty()) {
+			return;
+		}
+
+		m_objects.erase(std::remove_if(m_objects.begin(), m_objects.end(),
+			[&](const DrawableObjectData& o) { return ids.contains(o.id); }),
+			m_objects.end());
+		m_idToIndex.clear();
+		for (int i = 0; i < m_objects.size(); ++i) {
+			m_idToIndex[m_objects[i].id] = i;
+		}
+		for (const auto& id : ids) {
+			emit objectDeleted(id);
+		}
+		emit objectsUpdated(m_objects);
+		return;
+	}
+
 	qint64 ts = delta.value("timestamp").toVariant().toLongLong();
 
-	QString dataId;
+	if (action == "createBatch") {
+		const QJsonArray objects = delta.value("objects").toArray();
+		m_objects.reserve(m_objects.size() + objects.size());
+		for (const auto& value : objects) {
+			const QJsonObject entry = value.toObject();
+			const ObjectId id = ObjectId::fromString(entry.value("id").toString());
+			if (m_idToIndex.contains(id)) {
+				qWarning() << "Duplicate create action for id:" << entry.value("id").toString();
+				continue;
+			}
+			DrawableObjectData obj;
+			obj.id = id;
+			obj.properties = entry.value("data").toObject();
+			obj.type = static_cast<ObjType>(obj.properties["type"].toInt());
+			obj.timestamp = ts;
+			m_objects.append(obj);
+			m_idToIndex[id] = m_objects.size() - 1;
+
+			emit objectCreated(id, obj.properties, ts);
+		}
+		emit objectsUpdated(m_objects);
+		return;
+	}
+
+	if (action == "modifyBatch") {
+		const QJsonObject objects = delta.value("objects").toObject();
+		for (auto it = objects.begin(); it != objects.end(); ++it) {
+			const ObjectId id = ObjectId::fromString(it.key());
+			if (!m_idToIndex.contains(id)) {
+				qWarning() << "Smth went wrong no obj with this id:" << it.key();
+				continue;
+			}
+			DrawableObjectData& existing = m_objects[m_idToIndex[id]];
+			if (ts < existing.timestamp) {
+				continue;
+			}
+			existing.properties = it.value().toObject();
+			existing.type = static_cast<ObjType>(existing.properties["type"].toInt());
+			existing.timestamp = ts;
+
+			emit objectModified(id, existing.properties, ts);
+		}
+		emit objectsUpdated(m_objects);
+		return;
+	}
+
+	if (action == "replace") {
+		const QString oldKey = delta.value("id").toString();
+		const ObjectId oldId = ObjectId::fromString(oldKey);
+		if (!m_idToIndex.contains(oldId)) {
+			qWarning() << "Smth went wrong no obj with this id:" << oldKey;
+			return;
+		}
+		// An array, so the parts arrive in cut order.
+		const QJsonArray parts = delta.value("parts").toArray();
+
+		// The parts take the place of the original so the z-order is unchanged.
+		int index = m_idToIndex[oldId];
+		m_objects.removeAt(index);
+		QVector<DrawableObjectData> added;
+		for (const auto& value : parts) {
+			const QJsonObject part = value.toObject();
+			const ObjectId partId = ObjectId::fromString(part.value("id").toString());
+			if (m_idToIndex.contains(partId)) {
+				qWarning() << "Duplicate create action for id:" << part.value("id").toString();
+				continue;
+			}
+			DrawableObjectData obj;
+			obj.id = partId;
+			obj.properties = part.value("data").toObject();
+			obj.type = static_cast<ObjType>(obj.properties["type"].toInt());
+			obj.timestamp = ts;
+			m_objects.insert(index++, obj);
+			added.push_back(obj);
+		}
+		m_idToIndex.clear();
+		for (int i = 0; i < m_objects.size(); ++i) {
+			m_idToIndex[m_objects[i].id] = i;
+		}
+
+		emit objectDeleted(oldId);
+		for (const auto& obj : added) {
+			emit objectCreated(obj.id, obj.properties, ts);
+		}
+		emit objectsUpdated(m_objects);
+		return;
+	}
+
+	ObjectId dataId;
+	QString dataKey;
 	QJsonObject dataObject;
 	auto it = delta.constBegin();
 	++it;
 
 	for (auto it = delta.begin(); it != delta.end(); ++it) {
 		if (it.key() == "action" || it.key() == "timestamp") continue;
-		dataId = it.key();
+		dataKey = it.key();
+		dataId = ObjectId::fromString(dataKey);
 		dataObject = it.value().toObject();
 		break;
 	}
@@ -49,7 +194,7 @@ void DeltaCRDT::applyDelta(const QJsonObject& delta) {
 
 	if (action == "create") {
 		if (m_idToIndex.contains(dataId)) {
-			qWarning() << "Duplicate create action for id:" << dataId;
+			qWarning() << "Duplicate create action for id:" << dataKey;
 			return;
 		}
 
@@ -65,7 +210,7 @@ void DeltaCRDT::applyDelta(const QJsonObject& delta) {
 
 	}else if (action == "modify") {
 		if (!m_idToIndex.contains(dataId)) {
-			qWarning() << "Smth went wrong no obj with this id:" << dataId;
+			qWarning() << "Smth went wrong no obj with this id:" << dataKey;
 			return;
 		}
 		int index = m_idToIndex[dataId];
@@ -105,12 +250,79 @@ QJsonObject DeltaCRDT::generateDelta(const QString operation, const DrawableObje
 	delta["action"] = operation;
 
 	if (operation != "deleteAll") {
-		delta[obj.id] = obj.properties;
+		delta[obj.id.toString()] = obj.properties;
 		delta["timestamp"] = obj.timestamp;
 	}
 
 	return delta;
 }
 
+QJsonObject DeltaCRDT::generateCreateBatchDelta(const QVector<DrawableObjectData>& objs) {
+	QJsonArray objects;
+	qint64 ts = 0;
+	for (const auto& obj : objs) {
+		QJsonObject entry;
+		entry["id"] = obj.id.toString();
+		entry["data"] = obj.properties;
+		objects.append(entry);
+		ts = std::max(ts, obj.timestamp);
+	}
+
+	QJsonObject delta;
+	delta["action"] = "createBatch";
+	delta["objects"] = objects;
+	delta["timestamp"] = ts;
+	return delta;
+}
+
+QJsonObject DeltaCRDT::generateDeleteBatchDelta(const QVector<DrawableObjectData>& objs) {
+	QJsonArray ids;
+	qint64 ts = 0;
+	for (const auto& obj : objs) {
+		ids.append(obj.id.toString());
+		ts = std::max(ts, obj.timestamp);
+	}
+
+	QJsonObject delta;
+	delta["action"] = "deleteBatch";
+	delta["ids"] = ids;
+	delta["timestamp"] = ts;
+	return delta;
+}
+
+QJsonObject DeltaCRDT::generateModifyBatchDelta(const QVector<DrawableObjectData>& objs) {
+	QJsonObject objects;
+	qint64 ts = 0;
+	for (const auto& obj : objs) {
+		objects[obj.id.toString()] = obj.properties;
+		ts = std::max(ts, obj.timestamp);
+	}
+
+	QJsonObject delta;
+	delta["action"] = "modifyBatch";
+	delta["objects"] = objects;
+	delta["timestamp"] = ts;
+	return delta;
+}
+
+QJsonObject DeltaCRDT::generateReplaceDelta(const ObjectId oldId, const QVector<DrawableObjectData>& parts) {
+	QJsonArray partsArray;
+	qint64 ts = 0;
+	for (const auto& part : parts) {
+		QJsonObject entry;
+		entry["id"] = part.id.toString();
+		entry["data"] = part.properties;
+		partsArray.append(entry);
+		ts = std::max(ts, part.timestamp);
+	}
+
+	QJsonObject delta;
+	delta["action"] = "replace";
+	delta["id"] = oldId.toString();
+	delta["parts"] = partsArray;
+	delta["timestamp"] = ts;
+	return delta;
+}
+
 void DeltaCRDT::updateDrawableObjs(){}
 
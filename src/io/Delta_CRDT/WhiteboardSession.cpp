@@ -3,8 +3,9 @@
 
 WhiteboardSession::WhiteboardSession(QObject* parent)
     : QObject(parent) {
-    connect(&m_crdt, &DeltaCRDT::objectsUpdated,
-        this, &WhiteboardSession::objectsUpdated);
+    // objectsUpdated is only raised for network deltas: a local delta comes
+    // from the canvas, which already shows it, and rebuilding the whole scene
+    // from the CRDT would decode every object on each edit and load.
 }
 
 void WhiteboardSession::onLocalCreate(const DrawableObjectData& obj){
@@ -14,6 +15,16 @@ void WhiteboardSession::onLocalCreate(const DrawableObjectData& obj){
     broadcastDelta(delta);
 }
 
+void WhiteboardSession::onLocalCreateBatch(const QVector<DrawableObjectData>& objs){
+    if (objs.isEmpty()) {
+        return;
+    }
+    QJsonObject delta = m_crdt.generateCreateBatchDelta(objs);
+    m_crdt.applyDelta(delta);
+
+    broadcastDelta(delta);
+}
+
 void WhiteboardSession::onLocalModify(const DrawableObjectData& obj){
     QJsonObject delta = m_crdt.generateDelta("modify", obj);
     m_crdt.applyDelta(delta);
@@ -21,6 +32,16 @@ void WhiteboardSession::onLocalModify(const DrawableObjectData& obj){
     broadcastDelta(delta);
 }
 
+void WhiteboardSession::onLocalModifyBatch(const QVector<DrawableObjectData>& objs){
+    if (objs.isEmpty()) {
+        return;
+    }
+    QJsonObject delta = m_crdt.generateModifyBatchDelta(objs);
+    m_crdt.applyDelta(delta);
+
+    broadcastDelta(delta);
+}
+
 void WhiteboardSession::onLocalDelete(const DrawableObjectData& obj){
     QJsonObject delta = m_crdt.generateDelta("delete", obj);
     m_crdt.applyDelta(delta);
@@ -28,6 +49,23 @@ void WhiteboardSession::onLocalDelete(const DrawableObjectData& obj){
     broadcastDelta(delta);
 }
 
+void WhiteboardSession::onLocalDeleteBatch(const QVector<DrawableObjectData>& objs){
+    if (objs.isEmpty()) {
+        return;
+    }
+    QJsonObject delta = m_crdt.generateDeleteBatchDelta(objs);
+    m_crdt.applyDelta(delta);
+
+    broadcastDelta(delta);
+}
+
+void WhiteboardSession::onLocalReplace(const ObjectId oldId, const QVector<DrawableObjectData>& parts){
+    QJsonObject delta = m_crdt.generateReplaceDelta(oldId, parts);
+    m_crdt.applyDelta(delta);
+
+    broadcastDelta(delta);
+}
+
 void WhiteboardSession::broadcastDelta(const QJsonObject& delta)
 {
     emit deltaApplied(delta);
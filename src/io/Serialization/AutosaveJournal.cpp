@@ -0,0 +1,235 @@
+﻿#include <QCborValue>
+#include <QDebug>
+#include <QDir>
+#include <QtEndian>
+
+#include <DrawingLogic/CanvasWidget.h>
+#include <DrawingLogic/DrawableObject.h>
+#include <io/Delta_CRDT/CRDT.h>
+#include <io/Serialization/AutosaveJournal.h>
+#include <io/Serialization/BackgroundSaver.h>
+#include <io/Serialization/MappedBoard.h>
+#include <io/Serialization/Serialization.h>
+
+namespace {
+
+QByteArray le32(const quint32 value) {
+    char bytes[sizeof(value)];
+    qToLittleEndian(value, bytes);
+    return QByteArray(bytes, sizeof(value));
+}
+
+}
+
+AutosaveJournal::AutosaveJournal(CanvasWidget* canvas, const QString& directory, QObject* parent)
+    : QObject(parent), m_canvas(canvas), m_directory(directory), m_saver(new BackgroundSaver(this)) {
+    if (!QDir().mkpath(directory)) {
+        qWarning() << "Failed to create autosave directory:" << directory;
+    }
+    connect(m_saver, &BackgroundSaver::finished, this, &AutosaveJournal::snapshot_written);
+
+    m_timer.setInterval(COMPACT_INTERVAL_MS);
+    connect(&m_timer, &QTimer::timeout, this, &AutosaveJournal::compact);
+    m_timer.start();
+}
+
+AutosaveJournal::~AutosaveJournal() {
+    // Let a running snapshot finish before its files are dropped.
+    delete m_saver;
+    m_log.close();
+    QFile::remove(log_path());
+    QFile::remove(next_log_path());
+    // A recovered board may still map the snapshot.
+    MappedBoard::release(snapshot_path());
+    QFile::remove(snapshot_path());
+}
+
+QString AutosaveJournal::snapshot_path() const {
+    return QDir(m_directory).filePath("snapshot.wb");
+}
+
+QString AutosaveJournal::log_path() const {
+    return QDir(m_directory).filePath("journal.log");
+}
+
+QString AutosaveJournal::next_log_path() const {
+    return QDir(m_directory).filePath("journal.next.log");
+}
+
+bool AutosaveJournal::open_log(const QString& path) {
+    m_log.close();
+    m_log.setFileName(path);
+    if (!m_log.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Failed to open autosave journal:" << path << m_log.errorString();
+        return false;
+    }
+    if (m_log.size() == 0) {
+        m_log.write(le32(LOG_MAGIC));
+    }
+    m_log_bytes = m_log.size() - static_cast<qint64>(sizeof(LOG_MAGIC));
+    return true;
+}
+
+void AutosaveJournal::read_log(const QString& path, QVector<QJsonObject>& deltas) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    const QByteArray data = file.readAll();
+    const auto* at = reinterpret_cast<const uchar*>(data.constData());
+    const uchar* end = at + data.size();
+
+    if (end - at < 4 || qFromLittleEndian<quint32>(at) != LOG_MAGIC) {
+        qWarning() << "Not an autosave journal:" << path;
+        return;
+    }
+    at += 4;
+
+    while (at != end) {
+        if (end - at < 4) break;
+        const quint32 length = qFromLittleEndian<quint32>(at);
+        if (static_cast<quint64>(end - at - 4) < length) break;
+
+        const QByteArray record(reinterpret_cast<const char*>(at + 4), static_cast<qsizetype>(length));
+        deltas.push_back(QCborValue::fromCbor(record).toJsonValue().toObject());
+        at += 4 + length;
+    }
+    if (at != end) {
+        qWarning() << "Dropping torn record at the end of" << path;
+    }
+}
+
+bool AutosaveJournal::recover() {
+    const bool has_snapshot = QFile::exists(snapshot_path());
+    QVector<QJsonObject> deltas;
+    read_log(log_path(), deltas);
+    read_log(next_log_path(), deltas);
+
+    if (!has_snapshot && deltas.isEmpty()) {
+        QFile::remove(next_log_path());
+        open_log(log_path());
+        return false;
+    }
+
+    m_replaying = true;
+    if (has_snapshot && !CanvasSerializer::deserialize(m_canvas, snapshot_path())) {
+        qWarning() << "Failed to load autosave snapshot";
+    }
+
+    if (!deltas.isEmpty()) {
+        // Replayed on a private CRDT seeded with the snapshot, then swapped in.
+        // The seeds are stamped 0, older than any logged modify, so none of
+        // those is mistaken for stale. If a crash hit between a snapshot
+        // landing and its old log being dropped, that log is replayed over a
+        // snapshot that already holds it; creates of known ids are ignored
+        // there and its modifies set what the snapshot already has.
+        DeltaCRDT state;
+        QVector<DrawableObjectData> seeds;
+        seeds.reserve(static_cast<qsizetype>(m_canvas->objects().size()));
+        for (const auto& object : m_canvas->objects()) {
+            DrawableObjectData data = object->toDrawableObjectData();
+            data.timestamp = 0;
+            seeds.push_back(std::move(data));
+        }
+        state.applyDelta(state.generateCreateBatchDelta(seeds));
+        for (const auto& delta : deltas) {
+            state.applyDelta(delta);
+        }
+
+        std::vector<std::shared_ptr<DrawableObject>> objects;
+        for (const auto& data : state.getObjects()) {
+            if (auto object = DrawableObject::fromDrawableObjectData(data)) {
+                objects.push_back(std::move(object));
+            }
+        }
+        m_canvas->clear_all();
+        m_canvas->add_objects(objects);
+    }
+    m_replaying = false;
+
+    // Fold the replayed records into a new snapshot before logging resumes.
+    if (!deltas.isEmpty()) {
+        if (CanvasSerializer::write(m_canvas->objects(), snapshot_path())) {
+            QFile::remove(log_path());
+            QFile::remove(next_log_path());
+        } else {
+            qWarning() << "Failed to compact recovered autosave";
+        }
+    }
+    open_log(log_path());
+    return true;
+}
+
+void AutosaveJournal::append(const QJsonObject& delta) {
+    if (m_replaying || m_loading) return;
+    if (!m_log.isOpen() && !open_log(m_compacting ? next_log_path() : log_path())) {
+        return;
+    }
+
+    const QByteArray record = QCborValue::fromJsonValue(delta).toCbor();
+    QByteArray entry = le32(static_cast<quint32>(record.size()));
+    entry.append(record);
+    if (m_log.write(entry) != entry.size() || !m_log.flush()) {
+        qWarning() << "Failed to append to autosave journal:" << m_log.errorString();
+        return;
+    }
+
+    m_log_bytes += entry.size();
+    if (m_log_bytes > COMPACT_BYTES) {
+        compact();
+    }
+}
+
+void AutosaveJournal::compact() {
+    if (m_compacting || m_replaying || m_loading || (m_log_bytes == 0 && !m_unlogged)) return;
+
+    // Everything logged so far is already on the canvas, so the snapshot
+    // covers it; later records go to the next log.
+    m_compacting = true;
+    m_unlogged = false;
+    open_log(next_log_path());
+    m_saver->save(m_canvas, snapshot_path());
+}
+
+void AutosaveJournal::begin_load() {
+    m_loading = true;
+}
+
+void AutosaveJournal::end_load(const bool changed) {
+    m_loading = false;
+    if (!changed) return;
+
+    // A running snapshot predates the load; another one follows it.
+    m_unlogged = true;
+    compact();
+}
+
+void AutosaveJournal::snapshot_written(const QString&, const bool ok) {
+    m_log.close();
+    if (ok) {
+        QFile::remove(log_path());
+        if (!QFile::rename(next_log_path(), log_path())) {
+            qWarning() << "Failed to rotate autosave journal";
+        }
+    } else {
+        // Keep the old snapshot valid: its log continues with the next one.
+        qWarning() << "Autosave snapshot failed; keeping the journal";
+        QFile next(next_log_path());
+        QFile log(log_path());
+        if (next.open(QIODevice::ReadOnly) && log.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            log.write(next.readAll().mid(4));
+            log.close();
+            next.close();
+            QFile::remove(next_log_path());
+        }
+    }
+    m_compacting = false;
+    open_log(log_path());
+
+    if (!ok) {
+        // Left for the timer to retry, rather than failing in a loop.
+        m_unlogged = true;
+    } else if (m_unlogged) {
+        compact();
+    }
+}
@@ -0,0 +1,59 @@
+﻿#include <algorithm>
+#include <QMetaObject>
+#include <QRunnable>
+
+#include <DrawingLogic/CanvasWidget.h>
+#include <io/Serialization/BackgroundSaver.h>
+#include <io/Serialization/Serialization.h>
+
+BackgroundSaver::BackgroundSaver(QObject* parent)
+	: QObject(parent) {
+	m_pool.setMaxThreadCount(1);
+}
+
+BackgroundSaver::~BackgroundSaver() {
+	m_pool.waitForDone();
+	for (const auto& [snapshot, path] : m_queued) {
+		CanvasSerializer::write(snapshot, path);
+	}
+}
+
+void BackgroundSaver::save(const CanvasWidget* canvas, const QString& path) {
+	if (!canvas) {
+		qWarning() << "Cannot save null canvas";
+		return;
+	}
+	if (m_running) {
+		const auto queued = std::find_if(m_queued.begin(), m_queued.end(),
+			[&path](const auto& entry) { return entry.second == path; });
+		if (queued != m_queued.end()) {
+			queued->first = canvas->objects();
+		} else {
+			m_queued.emplace_back(canvas->objects(), path);
+		}
+		return;
+	}
+	start(canvas->objects(), path);
+}
+
+void BackgroundSaver::start(Snapshot snapshot, const QString& path) {
+	m_running = true;
+
+	m_pool.start(QRunnable::create([this, path, objects = std::move(snapshot)] {
+		const bool ok = CanvasSerializer::write(objects, path, [this](const qint64 done, const qint64 total) {
+			QMetaObject::invokeMethod(this, [this, done, total] {
+				emit progress(done, total);
+			}, Qt::QueuedConnection);
+		});
+
+		QMetaObject::invokeMethod(this, [this, path, ok] {
+			m_running = false;
+			emit finished(path, ok);
+			if (!m_queued.empty()) {
+				auto [next, next_path] = std::move(m_queued.front());
+				m_queued.erase(m_queued.begin());
+				start(std::move(next), next_path);
+			}
+		}, Qt::QueuedConnection);
+	}));
+}
@@ -0,0 +1,175 @@
+﻿#include <algorithm>
+#include <QDataStream>
+#include <QDebug>
+#include <QFileInfo>
+#include <QIODevice>
+#include <utility>
+#include <vector>
+
+#include <io/Serialization/MappedBoard.h>
+
+namespace {
+
+// Boards still mapping their file, for release().
+std::mutex open_boards_mutex;
+std::vector<std::weak_ptr<MappedBoard>> open_boards;
+
+}
+
+std::shared_ptr<MappedBoard> MappedBoard::open(const QString& path) {
+    std::shared_ptr<MappedBoard> board(new MappedBoard());
+    board->m_path = QFileInfo(path).canonicalFilePath();
+    board->m_file.setFileName(path);
+    if (!board->m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open file for reading:" << path << board->m_file.errorString();
+        return nullptr;
+    }
+
+    board->m_size = board->m_file.size();
+    board->m_map = board->m_file.map(0, board->m_size);
+    if (!board->m_map) {
+        qWarning() << "Failed to map file:" << path << board->m_file.errorString();
+        return nullptr;
+    }
+    board->m_data = board->m_map;
+
+    std::lock_guard lock(open_boards_mutex);
+    std::erase_if(open_boards, [](const std::weak_ptr<MappedBoard>& open) { return open.expired(); });
+    open_boards.push_back(board);
+    return board;
+}
+
+void MappedBoard::release(const QString& path) {
+#ifdef Q_OS_WIN
+    const QString canonical = QFileInfo(path).canonicalFilePath();
+    std::vector<std::shared_ptr<MappedBoard>> boards;
+    {
+        std::lock_guard lock(open_boards_mutex);
+        for (const auto& open : open_boards) {
+            if (auto board = open.lock(); board && board->m_path == canonical) {
+                boards.push_back(std::move(board));
+            }
+        }
+    }
+    for (const auto& board : boards) {
+        board->detach();
+    }
+#else
+    Q_UNUSED(path);
+#endif
+}
+
+MappedBoard::~MappedBoard() {
+    if (m_map) {
+        m_file.unmap(m_map);
+    }
+}
+
+void MappedBoard::detach() {
+    std::unique_lock lock(m_mutex);
+    if (!m_map) return;
+
+    m_bytes = QByteArray(reinterpret_cast<const char*>(m_map), m_size);
+    m_file.unmap(m_map);
+    m_file.close();
+    m_map = nullptr;
+    m_data = reinterpret_cast<const uchar*>(m_bytes.constData());
+}
+
+MappedObject::MappedObject(const ObjectId id_, const Record& record, std::shared_ptr<const MappedBoard> board)
+    : DrawableObject(id_, record.thickness, record.color), m_record(record), m_board(std::move(board)) {
+    bounds = m_record.bounds;
+}
+
+std::shared_ptr<DrawableObject> MappedObject::decode() const {
+    std::shared_lock lock(m_board->mutex());
+    const QByteArray bytes = QByteArray::fromRawData(
+        reinterpret_cast<const char*>(m_board->data() + m_record.offset), m_record.size);
+    QDataStream stream(bytes);
+
+    qint32 type = 0;
+    stream >> type;
+    std::shared_ptr<DrawableObject> object;
+    if (type == static_cast<qint32>(m_record.type)) {
+        object = DrawableObject::fromBin(stream, m_record.type);
+    }
+    if (!object || stream.status() != QDataStream::Ok) {
+        qWarning() << "Damaged record for object" << id.toString();
+        return make_drawable<DrawableBrokenLine>(id, QVector<QPointF>(), thickness, color);
+    }
+    return object;
+}
+
+DrawableObject& MappedObject::object() const {
+    std::call_once(m_decoded, [this] { m_object = decode(); });
+    return *m_object;
+}
+
+void MappedObject::draw(QPainter& painter) const {
+    object().draw(painter);
+}
+
+void MappedObject::move_by(const QPointF delta) {
+    object().move_by(delta);
+    bounds = object().bounding_rect();
+    m_edited = true;
+}
+
+std::shared_ptr<DrawableObject> MappedObject::clone() const {
+    return object().clone();
+}
+
+QPointF MappedObject::get_end() const {
+    return object().get_end();
+}
+
+bool MappedObject::contains_point(const QPointF pos, const int brush_thickness) const {
+    if (outside_bounds(pos, brush_thickness)) return false;
+    return object().contains_point(pos, brush_thickness);
+}
+
+bool MappedObject::intersects_segment(const QPointF from, const QPointF to, const int brush_thickness) const {
+    if (outside_bounds(from, to, brush_thickness)) return false;
+    return object().intersects_segment(from, to, brush_thickness);
+}
+
+bool MappedObject::erase_along(const QPointF from, const QPointF to, const int brush_thickness,
+    const std::function<ObjectId()>& make_id, std::vector<std::shared_ptr<DrawableObject>>& parts) const {
+    parts.clear();
+    if (outside_bounds(from, to, brush_thickness)) return false;
+    return object().erase_along(from, to, brush_thickness, make_id, parts);
+}
+
+QRectF MappedObject::compute_bounds() const {
+    return bounds;
+}
+
+void MappedObject::add_to_batch(RenderBatch& batch) const {
+    object().add_to_batch(batch);
+}
+
+QJsonObject MappedObject::toJson() const {
+    return m_edited ? object().toJson() : decode()->toJson();
+}
+
+QByteArray MappedObject::toBin() const {
+    if (m_edited) {
+        return object().toBin();
+    }
+    std::shared_lock lock(m_board->mutex());
+    return QByteArray(reinterpret_cast<const char*>(m_board->data() + m_record.offset), m_record.size);
+}
+
+DrawableObjectData MappedObject::toDrawableObjectData() const {
+    if (m_edited) {
+        return object().toDrawableObjectData();
+    }
+    // The stored record goes out as is and is only decoded by whoever turns
+    // the data back into an object, so registering a loaded board with the
+    // session costs no decoding.
+    DrawableObjectData result = DrawableObject::toDrawableObjectData();
+    result.type = m_record.type;
+    result.properties["type"] = static_cast<int>(m_record.type);
+    result.properties["record"] = QString::fromLatin1(toBin().toBase64());
+    return result;
+}
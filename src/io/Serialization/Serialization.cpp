@@ -1,18 +1,133 @@
-﻿#include <QFile>
+﻿#include <algorithm>
+#include <bit>
+#include <QFile>
 #include <QDataStream>
 #include <QDebug>
+#include <QHash>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QtEndian>
 #include <memory>
 
+#include <io/Serialization/MappedBoard.h>
 #include <io/Serialization/Serialization.h>
 #include <DrawingLogic/CanvasWidget.h>
 
+/* Version 3 layout
+
+  qint32 magic, qint32 version      big-endian, as written by QDataStream
+  header                            object count, client count, client and table offsets
+  records                           toBin() bytes of each object, back to back
+  client names                      u32 length + UTF-8 for each client of the ids
+  object table                      one fixed ENTRY_SIZE entry per object, in z-order
+
+  Header and table fields are little-endian. An entry holds the record offset
+  and size, type, id counter and file client index, thickness, world bounds
+  and color, which is all the scene needs before a record is decoded. An
+  all-ones counter marks an opaque id, stored whole as the client name; each
+  takes a client slot, so the index gets a full u32 of its own.
+
+*/
+
+namespace {
+
+constexpr qint64 PREAMBLE_SIZE = 8;
+constexpr qint64 HEADER_SIZE = 24;
+constexpr qint64 ENTRY_SIZE = 68;
+constexpr quint64 ID_COUNTER_MASK = (quint64(1) << 48) - 1;
+// Counter of an opaque id, whose client name is the whole id string.
+constexpr quint64 OPAQUE_FILE_COUNTER = ~quint64(0);
+// Version 1 and 2 streams: the object count, then each record as a QDataStream
+// QByteArray (big-endian u32 length, 0xffffffff for a null array).
+constexpr qint64 COUNT_SIZE = 4;
+constexpr quint32 NULL_RECORD = 0xffffffffu;
+// Fewer records than this per thread are not worth a worker.
+constexpr qsizetype MIN_DECODE_CHUNK = 256;
+
+template <typename T>
+void put(QByteArray& out, const T value) {
+    char bytes[sizeof(T)];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, sizeof(T));
+}
+
+template <typename T>
+T get(const uchar* at) {
+    return qFromLittleEndian<T>(at);
+}
+
+qreal get_real(const uchar* at) {
+    return std::bit_cast<qreal>(get<quint64>(at));
+}
+
+struct RecordSpan {
+    const uchar* data = nullptr;
+    quint32 size = 0;
+};
+
+std::shared_ptr<DrawableObject> decode_record(const RecordSpan span, const qint32 version, const qsizetype i) {
+    try {
+        const QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(span.data), span.size);
+        QDataStream stream(bytes);
+
+        qint32 typeInt = 0;
+        stream >> typeInt;
+        if (typeInt < 1 || typeInt > 4) {
+            qWarning() << "Invalid object type:" << typeInt << "for object" << i;
+            return nullptr;
+        }
+
+        const ObjType type = static_cast<ObjType>(typeInt);
+        auto obj = DrawableObject::fromBin(stream, type, version);
+        if (!obj) {
+            qWarning() << "Failed to deserialize object" << i << "of type" << static_cast<int>(type);
+        }
+        return obj;
+    }
+    catch (const std::exception& e) {
+        qWarning() << "Exception while decoding object" << i << ":" << e.what();
+        return nullptr;
+    }
+}
+
+// Calls fn(begin, end) over [0, count) in contiguous chunks, one per thread,
+// with the first chunk on the calling thread. Returns once all are done.
+template <typename Fn>
+void for_each_chunk(const qsizetype count, Fn&& fn) {
+    const qsizetype threads = std::max(1, QThread::idealThreadCount());
+    const qsizetype chunks = std::clamp<qsizetype>(count / MIN_DECODE_CHUNK, 1, threads);
+    if (chunks == 1) {
+        fn(qsizetype(0), count);
+        return;
+    }
+
+    const qsizetype step = (count + chunks - 1) / chunks;
+    QThreadPool pool;
+    pool.setMaxThreadCount(static_cast<int>(chunks - 1));
+    for (qsizetype begin = step; begin < count; begin += step) {
+        pool.start(QRunnable::create([&fn, begin, end = std::min(count, begin + step)] { fn(begin, end); }));
+    }
+    fn(qsizetype(0), step);
+    pool.waitForDone();
+}
+
+}
+
 bool CanvasSerializer::serialize(const CanvasWidget* canvas, const QString& path) {
     if (!canvas) {
         qWarning() << "Cannot serialize null canvas";
         return false;
     }
+    return write(canvas->objects(), path);
+}
 
-    QFile file(path);
+bool CanvasSerializer::write(const std::vector<std::shared_ptr<DrawableObject>>& objects, const QString& path,
+    const Progress& progress) {
+    // Written next to the target and renamed over it on commit; boards mapping
+    // |path| keep reading the old file.
+    QSaveFile file(path);
     if (!file.open(QIODevice::WriteOnly)) {
         qWarning() << "Failed to open file for writing:" << path << file.errorString();
         return false;
@@ -23,31 +138,105 @@ bool CanvasSerializer::serialize(const CanvasWidget* canvas, const QString& path
     try {
         stream << MAGIC_NUMBER;
         stream << FILE_VERSION;
+        file.write(QByteArray(HEADER_SIZE, '\0'));
 
-        const auto& objects = canvas->objects();
-        stream << static_cast<qint32>(objects.size());
+        const auto total = static_cast<qint64>(objects.size());
+        qint64 done = 0;
+        QByteArray table;
+        table.reserve(static_cast<qsizetype>(objects.size()) * ENTRY_SIZE);
+        QHash<quint16, quint32> file_clients;
+        QHash<QString, quint32> opaque_clients;
+        QByteArray clients;
+        quint32 client_count = 0;
+        auto add_client = [&](const QString& name) {
+            const QByteArray utf8 = name.toUtf8();
+            put<quint32>(clients, static_cast<quint32>(utf8.size()));
+            clients.append(utf8);
+            return client_count++;
+        };
+        quint32 count = 0;
+        qint64 offset = PREAMBLE_SIZE + HEADER_SIZE;
 
         for (const auto& obj : objects) {
+            if (progress && done % PROGRESS_STEP == 0) {
+                progress(done, total);
+            }
+            ++done;
             if (!obj) {
                 qWarning() << "Skipping null object during serialization";
                 continue;
             }
 
-            QByteArray objData = obj->toBin();
-            stream << objData;
+            const QByteArray record = obj->toBin();
+            file.write(record);
+
+            const ObjectId id = obj->get_id();
+            quint32 client = 0;
+            quint64 counter = id.counter();
+            if (id.isOpaque()) {
+                const QString text = id.toString();
+                counter = OPAQUE_FILE_COUNTER;
+                if (const auto known = opaque_clients.constFind(text); known != opaque_clients.constEnd()) {
+                    client = known.value();
+                } else {
+                    client = add_client(text);
+                    opaque_clients.insert(text, client);
+                }
+            } else if (const auto known = file_clients.constFind(id.client()); known != file_clients.constEnd()) {
+                client = known.value();
+            } else {
+                client = add_client(ObjectId::clientName(id.client()));
+                file_clients.insert(id.client(), client);
+            }
+
+            const QRectF& bounds = obj->bounding_rect();
+            put<quint64>(table, static_cast<quint64>(offset));
+            put<quint32>(table, static_cast<quint32>(record.size()));
+            put<quint32>(table, static_cast<quint32>(obj->get_type()));
+            put<quint64>(table, counter);
+            put<quint32>(table, client);
+            put<qint32>(table, obj->get_thickness());
+            put<quint64>(table, std::bit_cast<quint64>(bounds.left()));
+            put<quint64>(table, std::bit_cast<quint64>(bounds.top()));
+            put<quint64>(table, std::bit_cast<quint64>(bounds.right()));
+            put<quint64>(table, std::bit_cast<quint64>(bounds.bottom()));
+            put<quint32>(table, obj->get_color().rgba());
+
+            offset += record.size();
+            ++count;
         }
 
-        file.close();
+        const qint64 clients_offset = offset;
+        file.write(clients);
+        const qint64 table_offset = clients_offset + clients.size();
+        file.write(table);
+
+        QByteArray header;
+        put<quint32>(header, count);
+        put<quint32>(header, client_count);
+        put<quint64>(header, static_cast<quint64>(clients_offset));
+        put<quint64>(header, static_cast<quint64>(table_offset));
+        file.seek(PREAMBLE_SIZE);
+        file.write(header);
+
+        MappedBoard::release(path);
+        if (!file.commit()) {
+            qWarning() << "Failed to write file:" << path << file.errorString();
+            return false;
+        }
+        if (progress) {
+            progress(total, total);
+        }
         return true;
     }
     catch (const std::exception& e) {
         qWarning() << "Exception during serialization:" << e.what();
-        file.close();
+        file.cancelWriting();
         return false;
     }
     catch (...) {
         qWarning() << "Unknown exception during serialization";
-        file.close();
+        file.cancelWriting();
         return false;
     }
 }
@@ -77,51 +266,18 @@ bool CanvasSerializer::deserialize(CanvasWidget* canvas, const QString& path) {
             return false;
         }
 
-        if (version != FILE_VERSION) {
+        if (version < MIN_FILE_VERSION || version > FILE_VERSION) {
             qWarning() << "Unsupported file version:" << version;
             file.close();
             return false;
         }
 
-        canvas->clear_all();
-
-        qint32 objectCount;
-        stream >> objectCount;
-
-        if (objectCount < 0) {
-            qWarning() << "Invalid object count:" << objectCount;
+        if (version >= 3) {
             file.close();
-            return false;
+            return deserialize_mapped(canvas, path);
         }
 
-        for (qint32 i = 0; i < objectCount; ++i) {
-            QByteArray objData;
-            stream >> objData;
-
-            QDataStream objStream(&objData, QIODevice::ReadOnly);
-
-            qint32 typeInt;
-            objStream >> typeInt;
-
-            if (typeInt < 1 || typeInt > 4) {
-                qWarning() << "Invalid object type:" << typeInt << "for object" << i;
-                continue;
-            }
-
-            ObjType type = static_cast<ObjType>(typeInt);
-
-            auto obj = DrawableObject::fromBin(objStream, type);
-
-            if (obj) {
-                canvas->addObject(obj);
-            }
-            else {
-                qWarning() << "Failed to deserialize object" << i << "of type" << static_cast<int>(type);
-            }
-        }
-
-        file.close();
-        return true;
+        return deserialize_records(canvas, file, version);
     }
     catch (const std::exception& e) {
         qWarning() << "Exception during deserialization:" << e.what();
@@ -133,4 +289,157 @@ bool CanvasSerializer::deserialize(CanvasWidget* canvas, const QString& path) {
         file.close();
         return false;
     }
-}
\ No newline at end of file
+}
+
+bool CanvasSerializer::deserialize_records(CanvasWidget* canvas, QFile& file, const qint32 version) {
+    const qint64 size = file.size();
+    uchar* data = size > 0 ? file.map(0, size) : nullptr;
+    if (!data) {
+        qWarning() << "Failed to map file:" << file.fileName() << file.errorString();
+        return false;
+    }
+    if (size < PREAMBLE_SIZE + COUNT_SIZE) {
+        qWarning() << "Truncated board header";
+        file.unmap(data);
+        return false;
+    }
+
+    const qint32 objectCount = qFromBigEndian<qint32>(data + PREAMBLE_SIZE);
+    if (objectCount < 0) {
+        qWarning() << "Invalid object count:" << objectCount;
+        file.unmap(data);
+        return false;
+    }
+
+    // Boundaries only: a record is skipped over by its length prefix.
+    std::vector<RecordSpan> records;
+    records.reserve(static_cast<size_t>(std::min<qint64>(objectCount, (size - PREAMBLE_SIZE - COUNT_SIZE) / 4)));
+    const uchar* at = data + PREAMBLE_SIZE + COUNT_SIZE;
+    const uchar* end = data + size;
+    for (qint32 i = 0; i < objectCount; ++i) {
+        if (end - at < 4) {
+            qWarning() << "Truncated board: read" << i << "of" << objectCount << "objects";
+            break;
+        }
+        const quint32 length = qFromBigEndian<quint32>(at);
+        at += 4;
+        if (length == NULL_RECORD) {
+            records.push_back({});
+            continue;
+        }
+        if (static_cast<quint64>(end - at) < length) {
+            qWarning() << "Truncated board: read" << i << "of" << objectCount << "objects";
+            break;
+        }
+        records.push_back({ at, length });
+        at += length;
+    }
+
+    // Each slot is written by exactly one chunk, so the file order survives.
+    std::vector<std::shared_ptr<DrawableObject>> objects(records.size());
+    for_each_chunk(static_cast<qsizetype>(records.size()), [&](const qsizetype begin, const qsizetype chunk_end) {
+        for (qsizetype i = begin; i < chunk_end; ++i) {
+            objects[i] = decode_record(records[i], version, i);
+        }
+    });
+    file.unmap(data);
+
+    std::erase(objects, nullptr);
+    canvas->clear_all();
+    canvas->add_objects(objects);
+    return true;
+}
+
+bool CanvasSerializer::deserialize_mapped(CanvasWidget* canvas, const QString& path) {
+    auto board = MappedBoard::open(path);
+    if (!board) {
+        return false;
+    }
+    std::shared_lock lock(board->mutex());
+
+    const uchar* data = board->data();
+    const qint64 size = board->size();
+    if (size < PREAMBLE_SIZE + HEADER_SIZE) {
+        qWarning() << "Truncated board header";
+        return false;
+    }
+
+    const uchar* header = data + PREAMBLE_SIZE;
+    const quint32 count = get<quint32>(header);
+    const quint32 client_count = get<quint32>(header + 4);
+    const quint64 clients_offset = get<quint64>(header + 8);
+    const quint64 table_offset = get<quint64>(header + 16);
+    if (clients_offset < PREAMBLE_SIZE + HEADER_SIZE || clients_offset > table_offset
+        || table_offset > static_cast<quint64>(size)
+        || (static_cast<quint64>(size) - table_offset) / ENTRY_SIZE < count
+        || (table_offset - clients_offset) / 4 < client_count) {
+        qWarning() << "Invalid board header";
+        return false;
+    }
+
+    QVector<QString> clients;
+    clients.reserve(client_count);
+    const uchar* at = data + clients_offset;
+    const uchar* clients_end = data + table_offset;
+    for (quint32 i = 0; i < client_count; ++i) {
+        if (clients_end - at < 4) {
+            qWarning() << "Truncated client table";
+            return false;
+        }
+        const quint32 length = get<quint32>(at);
+        at += 4;
+        if (static_cast<quint64>(clients_end - at) < length) {
+            qWarning() << "Truncated client table";
+            return false;
+        }
+        clients.push_back(QString::fromUtf8(reinterpret_cast<const char*>(at), static_cast<qsizetype>(length)));
+        at += length;
+    }
+
+    QVector<qint32> interned(clients.size(), -1);
+    std::vector<std::shared_ptr<DrawableObject>> objects;
+    objects.reserve(count);
+    const uchar* entry = data + table_offset;
+    for (quint32 i = 0; i < count; ++i, entry += ENTRY_SIZE) {
+        MappedObject::Record record;
+        record.offset = static_cast<qint64>(get<quint64>(entry));
+        record.size = get<quint32>(entry + 8);
+        const quint32 type = get<quint32>(entry + 12);
+        const quint64 counter = get<quint64>(entry + 16);
+        const quint32 client = get<quint32>(entry + 24);
+
+        if (type < 1 || type > 3 || client >= static_cast<quint64>(clients.size())
+            || (counter != OPAQUE_FILE_COUNTER && counter > ID_COUNTER_MASK)
+            || record.offset < PREAMBLE_SIZE + HEADER_SIZE
+            || static_cast<quint64>(record.offset) + record.size > clients_offset) {
+            qWarning() << "Invalid table entry for object" << i;
+            continue;
+        }
+
+        record.type = static_cast<ObjType>(type);
+        record.thickness = get<qint32>(entry + 28);
+        record.bounds = QRectF(QPointF(get_real(entry + 32), get_real(entry + 40)),
+            QPointF(get_real(entry + 48), get_real(entry + 56)));
+        record.color = QColor::fromRgba(get<quint32>(entry + 64));
+
+        const QString& client_name = clients[static_cast<qsizetype>(client)];
+        ObjectId object_id;
+        if (counter == OPAQUE_FILE_COUNTER) {
+            object_id = ObjectId::fromString(client_name);
+        } else {
+            // Interned on first use, so opaque names never take a client slot.
+            qint32& index = interned[static_cast<qsizetype>(client)];
+            if (index < 0) {
+                index = ObjectId::internClient(client_name);
+            }
+            object_id = index > 0 ? ObjectId(static_cast<quint16>(index), counter)
+                                  : ObjectId::fromString(client_name + "-" + QString::number(counter));
+        }
+        objects.push_back(make_drawable<MappedObject>(object_id, record, board));
+    }
+    lock.unlock();
+
+    canvas->clear_all();
+    canvas->add_objects(objects);
+    return true;
+}
@@ -0,0 +1,116 @@
+﻿#include <cmath>
+#include <QDebug>
+
+#include <DrawingLogic/StrokeCodec.h>
+
+namespace {
+
+int failures = 0;
+
+void check(const bool ok, const char* what) {
+	if (!ok) {
+		qWarning() << "FAIL:" << what;
+		++failures;
+	}
+}
+
+// A stroke drawn at |scale| the way BrushTool samples it: screen pixels
+// mapped back to world coordinates, so nothing lands on a binary grid.
+QVector<QPointF> stroke_at(const qreal scale, const QPointF origin) {
+	QVector<QPointF> points;
+	for (int i = 0; i < 1000; ++i) {
+		const QPointF screen(i * 1.37, 40 * std::sin(i * 0.05));
+		points.append(QPointF(origin.x() + screen.x() / scale, origin.y() + screen.y() / scale));
+	}
+	return points;
+}
+
+qreal largest_error(const QVector<QPointF>& a, const QVector<QPointF>& b) {
+	qreal error = 0;
+	for (qsizetype i = 0; i < a.size(); ++i) {
+		error = std::max({ error, std::abs(a[i].x() - b[i].x()), std::abs(a[i].y() - b[i].y()) });
+	}
+	return error;
+}
+
+void round_trip_at(const qreal scale) {
+	// Same step BrushTool packs at: a sixteenth of a screen pixel.
+	const qreal step = 1.0 / 16 / scale;
+	const QVector<QPointF> points = stroke_at(scale, QPointF(12345.678, -9876.543));
+	const int bits = stroke_codec::fraction_bits_for(step);
+
+	QVector<QPointF> decoded;
+	check(stroke_codec::decode(stroke_codec::encode(points, bits), decoded), "decode");
+	check(decoded.size() == points.size(), "point count");
+	if (decoded.size() != points.size()) return;
+	if (bits == stroke_codec::EXACT_BITS) {
+		check(decoded == points, "exact points survive unchanged");
+	} else {
+		check(largest_error(points, decoded) <= step / 2, "error within half a grid step");
+	}
+}
+
+void high_zoom() {
+	check(stroke_codec::fraction_bits_for(1.0 / 16) == 4, "1:1 keeps a sixteenth of a pixel");
+	check(stroke_codec::fraction_bits_for(1.0 / 16 / 256) == 12, "256x zoom takes 12 bits");
+	check(stroke_codec::fraction_bits_for(1.0 / 16 / 1e6) == stroke_codec::EXACT_BITS, "beyond 16 bits is exact");
+	for (const qreal scale : { 0.1, 1.0, 64.0, 256.0, 4096.0, 1e6 }) {
+		round_trip_at(scale);
+	}
+}
+
+void lossless() {
+	const QVector<QPointF> grid{ { 1.5, -2.25 }, { 3.125, 4 } };
+	check(stroke_codec::lossless_fraction_bits(grid) == 3, "coarsest exact grid");
+	QVector<QPointF> decoded;
+	check(stroke_codec::decode(stroke_codec::encode(grid, 3), decoded) && decoded == grid, "grid points survive");
+
+	// What a version 1 file holds.
+	const QVector<QPointF> doubles{ { 0.1, 0.2 }, { 1e-9, 1e9 + 0.3 } };
+	check(stroke_codec::lossless_fraction_bits(doubles) == stroke_codec::EXACT_BITS, "no grid holds raw doubles");
+	check(stroke_codec::decode(stroke_codec::encode(doubles, stroke_codec::EXACT_BITS), decoded)
+		&& decoded == doubles, "raw doubles survive");
+}
+
+void translate() {
+	for (const int bits : { 4, 14, stroke_codec::EXACT_BITS }) {
+		const QVector<QPointF> points = stroke_at(1000, QPointF(5, 5));
+		const QByteArray data = stroke_codec::encode(points, bits);
+		const QPointF delta = stroke_codec::snap(QPointF(0.123456789, -7.654321), bits);
+		QVector<QPointF> before;
+		QVector<QPointF> after;
+		check(stroke_codec::decode(data, before) && stroke_codec::decode(stroke_codec::translate(data, delta), after)
+			&& after.size() == before.size(), "translate decodes");
+		for (qsizetype i = 0; i < before.size() && i < after.size(); ++i) {
+			before[i] += delta;
+		}
+		check(after == before, "translate moves every point by the snapped delta");
+	}
+}
+
+void resume() {
+	const QVector<QPointF> points = stroke_at(1e6, QPointF());
+	const QByteArray data = stroke_codec::encode(points, stroke_codec::EXACT_BITS);
+	stroke_codec::Reader reader(data);
+	QPointF point;
+	for (int i = 0; i < 500; ++i) {
+		reader.next(point);
+	}
+	const stroke_codec::Cursor cursor = reader.cursor();
+	stroke_codec::Reader resumed(data);
+	resumed.seek(cursor);
+	check(resumed.next(point) && point == points[500], "exact reader resumes at a cursor");
+}
+
+}
+
+int main() {
+	high_zoom();
+	lossless();
+	translate();
+	resume();
+	if (failures) {
+		qWarning() << failures << "stroke codec checks failed";
+	}
+	return failures ? 1 : 0;
+}